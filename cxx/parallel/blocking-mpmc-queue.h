@@ -0,0 +1,83 @@
+#pragma once
+
+#include "event-count.h"
+#include "mpmc-bounded-stack.h"
+#include "spin-wait.h"
+
+#include <optional>
+#include <utility>
+
+// BlockingMPMCQueue adds blocking Push/Pop on top of MPMCBoundedQueue.
+//
+// Every operation first goes through the lock-free queue. Only when it fails the thread spins
+// for a while and then parks on an EventCount, one for each direction. The other side pays for
+// the wakeup only while somebody is parked, so an uncontended Push/Pop adds no syscall and no
+// read-modify-write to the queue's own.
+template <class T, bool kPadSlots = false>
+class BlockingMPMCQueue {
+public:
+    explicit BlockingMPMCQueue(int max_size) : queue_(max_size) {
+    }
+
+    bool TryPush(const T& value) {
+        return Notified(queue_.Enqueue(value), not_empty_);
+    }
+
+    bool TryPush(T&& value) {
+        return Notified(queue_.Enqueue(std::move(value)), not_empty_);
+    }
+
+    bool TryPop(T& value) {
+        return Notified(queue_.Dequeue(value), not_full_);
+    }
+
+    bool TryPop(std::optional<T>& value) {
+        return Notified(queue_.Dequeue(value), not_full_);
+    }
+
+    void Push(const T& value) {
+        Await(not_full_, [&]() -> bool { return queue_.Enqueue(value); });
+        not_empty_.Notify();
+    }
+
+    // Push moves value in only once there is room for it.
+    void Push(T&& value) {
+        Await(not_full_, [&]() -> bool { return queue_.Enqueue(std::move(value)); });
+        not_empty_.Notify();
+    }
+
+    // Pop moves the element straight out of its slot, T needs no default constructor.
+    T Pop() {
+        std::optional<T> value;
+        Await(not_empty_, [&]() -> bool { return queue_.Dequeue(value); });
+        not_full_.Notify();
+        return std::move(*value);
+    }
+
+private:
+    static bool Notified(bool done, EventCount& event) {
+        if (done) {
+            event.Notify();
+        }
+        return done;
+    }
+
+    template <class Operation>
+    void Await(EventCount& event, Operation operation) {
+        if (spin_.Spin(operation)) {
+            return;
+        }
+        while (true) {
+            EventCount::Key key = event.PrepareWait();
+            if (operation()) {
+                event.CancelWait();
+                return;
+            }
+            event.Wait(key);
+        }
+    }
+
+    MPMCBoundedQueue<T, kPadSlots> queue_;
+    EventCount not_empty_, not_full_;
+    AdaptiveSpin spin_;
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "channel-status.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// BroadcastOverflow is what a full BroadcastChannel does to a sender.
+//
+// kBlock makes the sender wait for the slowest subscriber. kDropOldest never blocks: the oldest
+// message is overwritten and subscribers that hadn't read it skip ahead and count it as lagged.
+enum class BroadcastOverflow { kBlock, kDropOldest };
+
+// BroadcastChannel delivers every message to every subscriber.
+//
+// Messages are stored once, as shared_ptr<const T> in a ring of capacity slots, and every
+// Subscriber has its own read cursor into the ring, so fan-out to N subscribers costs N
+// refcount increments instead of N copies. A subscriber only sees messages sent after it
+// subscribed. A ring slot keeps its payload alive until the slot is reused.
+template <class T>
+class BroadcastChannel {
+    struct Cursor {
+        uint64_t next;
+        uint64_t lagged = 0;
+    };
+
+public:
+    using Payload = std::shared_ptr<const T>;
+
+    // Subscriber is a read cursor, it unsubscribes when destroyed. The channel must outlive it.
+    class Subscriber {
+    public:
+        Subscriber(Subscriber&& other) noexcept
+            : channel_(std::exchange(other.channel_, nullptr)), cursor_(other.cursor_) {
+        }
+
+        Subscriber& operator=(Subscriber&& other) noexcept {
+            if (this != &other) {
+                Unsubscribe();
+                channel_ = std::exchange(other.channel_, nullptr);
+                cursor_ = other.cursor_;
+            }
+            return *this;
+        }
+
+        ~Subscriber() {
+            Unsubscribe();
+        }
+
+        // Recv blocks for the next message, nullptr means the channel is closed and drained.
+        Payload Recv() {
+            return channel_->Recv(*cursor_);
+        }
+
+        // TryRecv never blocks: kOk with message set, kEmpty or kClosed once closed and drained.
+        ChannelStatus TryRecv(Payload& message) {
+            return channel_->TryRecv(*cursor_, message);
+        }
+
+        // Lagged is the number of messages this subscriber lost to kDropOldest.
+        uint64_t Lagged() const {
+            std::unique_lock<std::mutex> lock(channel_->mutex_);
+            return cursor_->lagged;
+        }
+
+    private:
+        friend class BroadcastChannel;
+
+        Subscriber(BroadcastChannel* channel, typename std::list<Cursor>::iterator cursor)
+            : channel_(channel), cursor_(cursor) {
+        }
+
+        void Unsubscribe() {
+            if (channel_) {
+                std::exchange(channel_, nullptr)->Unsubscribe(cursor_);
+            }
+        }
+
+        BroadcastChannel* channel_;
+        typename std::list<Cursor>::iterator cursor_;
+    };
+
+    explicit BroadcastChannel(size_t capacity,
+                              BroadcastOverflow overflow = BroadcastOverflow::kBlock)
+        : ring_(std::max<size_t>(capacity, 1)), overflow_(overflow) {
+    }
+
+    BroadcastChannel(const BroadcastChannel&) = delete;
+    BroadcastChannel& operator=(const BroadcastChannel&) = delete;
+
+    Subscriber Subscribe() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cursors_.push_back(Cursor{head_});
+        return Subscriber(this, std::prev(cursors_.end()));
+    }
+
+    void Send(T value) {
+        Send(std::make_shared<const T>(std::move(value)));
+    }
+
+    // Send publishes message, blocking while the slowest subscriber is capacity messages behind
+    // under kBlock.
+    void Send(Payload message) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (overflow_ == BroadcastOverflow::kBlock) {
+            ++send_waiters_;
+            not_full_.wait(lock, [this] { return closed_ || HasRoom(); });
+            --send_waiters_;
+        }
+        if (closed_) {
+            throw std::runtime_error("channel closed");
+        }
+        Publish(std::move(message));
+    }
+
+    // TrySend never blocks: kOk, kFull (kBlock only) or kClosed. message is left untouched
+    // unless sent.
+    ChannelStatus TrySend(Payload& message) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (closed_) {
+            return ChannelStatus::kClosed;
+        }
+        if (overflow_ == BroadcastOverflow::kBlock && !HasRoom()) {
+            return ChannelStatus::kFull;
+        }
+        Publish(std::move(message));
+        return ChannelStatus::kOk;
+    }
+
+    void Close() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+private:
+    // The ring holds messages [head_ - ring_.size(), head_), the older ones are gone.
+    uint64_t Oldest() const {
+        return head_ > ring_.size() ? head_ - ring_.size() : 0;
+    }
+
+    bool HasRoom() const {
+        for (const Cursor& cursor : cursors_) {
+            if (head_ - cursor.next >= ring_.size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Publish(Payload message) {
+        ring_[head_ % ring_.size()] = std::move(message);
+        ++head_;
+        if (recv_waiters_ > 0) {
+            not_empty_.notify_all();
+        }
+    }
+
+    // Take hands out the message at cursor, skipping whatever was overwritten meanwhile.
+    Payload Take(Cursor& cursor) {
+        if (cursor.next < Oldest()) {
+            cursor.lagged += Oldest() - cursor.next;
+            cursor.next = Oldest();
+        }
+        Payload message = ring_[cursor.next % ring_.size()];
+        ++cursor.next;
+        if (send_waiters_ > 0) {
+            not_full_.notify_all();
+        }
+        return message;
+    }
+
+    Payload Recv(Cursor& cursor) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ++recv_waiters_;
+        not_empty_.wait(lock, [&] { return closed_ || cursor.next != head_; });
+        --recv_waiters_;
+        return cursor.next != head_ ? Take(cursor) : nullptr;
+    }
+
+    ChannelStatus TryRecv(Cursor& cursor, Payload& message) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (cursor.next == head_) {
+            return closed_ ? ChannelStatus::kClosed : ChannelStatus::kEmpty;
+        }
+        message = Take(cursor);
+        return ChannelStatus::kOk;
+    }
+
+    void Unsubscribe(typename std::list<Cursor>::iterator cursor) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cursors_.erase(cursor);
+        if (send_waiters_ > 0) {
+            not_full_.notify_all();
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::condition_variable not_full_, not_empty_;
+    std::vector<Payload> ring_;
+    uint64_t head_ = 0;
+    std::list<Cursor> cursors_;
+    int send_waiters_ = 0;
+    int recv_waiters_ = 0;
+    bool closed_ = false;
+    const BroadcastOverflow overflow_;
+};
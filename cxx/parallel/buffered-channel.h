@@ -1,70 +1,742 @@
 #pragma once
 
+#include "channel-stats.h"
+#include "channel-status.h"
+#include "executor.h"
+#include "select.h"
+#include "tagged-slot.h"
+
 #include <utility>
+#include <algorithm>
+#include <span>
+#include <memory>
+#include <iterator>
+#include <type_traits>
 #include <optional>
-#include <queue>
+#include <vector>
 #include <mutex>
 #include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <deque>
+#include <coroutine>
 #include <condition_variable>
+#include <chrono>
 
-template <class T>
+// BufferedChannel is a bounded MPMC channel.
+//
+// Elements live in a preallocated power-of-two ring with per-slot tags (the same protocol
+// MPMCBoundedQueue uses), so Send/Recv never take a lock unless the channel is full or empty.
+// Only then the thread parks on a condition variable. Slots are TaggedSlots, so T must be
+// nothrow move constructible.
+//
+// StatsPolicy is NoChannelStats by default. BufferedChannel<T, ChannelCounters> additionally
+// tracks depth, throughput and park times, see Stats().
+template <class T, class StatsPolicy = NoChannelStats>
 class BufferedChannel {
 public:
-    explicit BufferedChannel(int size) : max_size_(size), open_(true) {
+    explicit BufferedChannel(int size)
+        : capacity_(size > 0 ? size : 1), data_(RoundUp(capacity_)), mask_(data_.size() - 1) {
+        for (uint64_t i = 0; i < data_.size(); ++i) {
+            data_[i].tag.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~BufferedChannel() {
+        uint64_t current_head = head_.load() & ~kClosedBit;
+        for (uint64_t i = tail_.load(); i != current_head; ++i) {
+            std::destroy_at(data_[i & mask_].Get());
+        }
     }
 
     void Send(const T& value) {
-        if (!open_) {
-            throw std::runtime_error("https://www.youtube.com/watch?v=0VTIeL9wmQE");
+        Emplace(value);
+    }
+
+    void Send(T&& value) {
+        Emplace(std::move(value));
+    }
+
+    // Emplace is Send with the element built from args, in its slot whenever kEmplacesInPlace.
+    template <class... Args>
+    void Emplace(Args&&... args) {
+        if constexpr (kEmplacesInPlace<T, Args...>) {
+            SendInPlace(std::forward<Args>(args)...);
+        } else {
+            SendInPlace(T(std::forward<Args>(args)...));
+        }
+    }
+
+    std::optional<T> Recv() {
+        WaitTimer timer(*this, recv_side_);
+        while (true) {
+            std::optional<T> value;
+            ChannelStatus status = TryPop(value);
+            if (status == ChannelStatus::kOk) {
+                Wake(send_side_);
+                return value;
+            }
+            if (status == ChannelStatus::kClosed) {
+                return std::nullopt;
+            }
+
+            std::unique_lock<std::mutex> ul(m_);
+            Park(ul, recv_side_, timer, [this]() -> bool { return CanPop(); });
         }
+    }
 
-        std::unique_lock<std::mutex> ul(m_);
-        if (queue_.size() == max_size_) {
-            cv_send_.wait(ul, [this]() -> bool { return queue_.size() < max_size_ || !open_; });
+    // SendMany blocks until at least one element fits, then sends as many elements from the
+    // front of values as there is room for with one slot claim and one wakeup. Elements are
+    // copied straight into the slots unless T's copy may throw, then only as many as currently
+    // fit are copied up front.
+    //
+    // Returns the number of elements sent.
+    size_t SendMany(std::span<const T> values) {
+        if (values.empty()) {
+            return 0;
+        }
+        if constexpr (!std::is_nothrow_copy_constructible_v<T>) {
+            // If the channel is full, one copy is enough to wait for the first free slot with.
+            uint64_t room = Room(head_.load(std::memory_order_relaxed) & ~kClosedBit);
+            uint64_t size = std::min<uint64_t>(values.size(), std::max<uint64_t>(room, 1));
+            std::vector<T> copies(values.begin(), values.begin() + size);
+            return PushMany(std::make_move_iterator(copies.begin()), copies.size());
+        } else {
+            return PushMany(values.begin(), values.size());
         }
+    }
 
-        if (!open_) {
-            throw std::runtime_error("https://www.youtube.com/watch?v=0VTIeL9wmQE");
+    // RecvMany blocks until at least one element is available, then writes up to max elements
+    // to out with one slot claim and one wakeup. If writing to out throws, the rest of the
+    // claimed batch is dropped and the exception is rethrown.
+    //
+    // Returns the number of elements received, 0 means the channel is closed and drained.
+    template <class OutputIt>
+    size_t RecvMany(OutputIt out, size_t max) {
+        if (max == 0) {
+            return 0;
         }
+        WaitTimer timer(*this, recv_side_);
+        while (true) {
+            uint64_t first, count;
+            ChannelStatus status = ClaimPop(max, first, count);
+            if (status == ChannelStatus::kOk) {
+                uint64_t i = 0;
+                try {
+                    for (; i < count; ++i) {
+                        Node& node = data_[(first + i) & mask_];
+                        *out = std::move(*node.Get());
+                        ++out;
+                        ReleasePopped(first + i);
+                    }
+                } catch (...) {
+                    // The slots are claimed already, they have to be freed either way.
+                    for (; i < count; ++i) {
+                        ReleasePopped(first + i);
+                    }
+                    Wake(send_side_, count);
+                    throw;
+                }
+                Wake(send_side_, count);
+                return count;
+            }
+            if (status == ChannelStatus::kClosed) {
+                return 0;
+            }
 
-        queue_.push_back(value);
-        cv_recv_.notify_one();
+            std::unique_lock<std::mutex> ul(m_);
+            Park(ul, recv_side_, timer, [this]() -> bool { return CanPop(); });
+        }
     }
 
-    std::optional<T> Recv() {
-        std::unique_lock<std::mutex> ul(m_);
+    // TrySend never blocks: kOk, kFull or kClosed. value is left untouched unless sent.
+    ChannelStatus TrySend(const T& value) {
+        return TrySendImpl(value);
+    }
 
-        if (queue_.empty() && !open_) {
-            return std::nullopt;
+    ChannelStatus TrySend(T&& value) {
+        return TrySendImpl(std::move(value));
+    }
+
+    // TryRecv never blocks: kOk with value set, kEmpty or kClosed once closed and drained.
+    ChannelStatus TryRecv(std::optional<T>& value) {
+        ChannelStatus status = TryPop(value);
+        if (status == ChannelStatus::kOk) {
+            Wake(send_side_);
         }
+        return status;
+    }
+
+    // SendFor/SendUntil block until there is room, the deadline passes (kTimeout) or the channel
+    // is closed (kClosed). On failure value is left untouched.
+    template <class Rep, class Period>
+    ChannelStatus SendFor(const T& value, std::chrono::duration<Rep, Period> timeout) {
+        return SendUntil(value, std::chrono::steady_clock::now() + timeout);
+    }
+
+    template <class Rep, class Period>
+    ChannelStatus SendFor(T&& value, std::chrono::duration<Rep, Period> timeout) {
+        return SendUntil(std::move(value), std::chrono::steady_clock::now() + timeout);
+    }
+
+    template <class Clock, class Duration>
+    ChannelStatus SendUntil(const T& value, std::chrono::time_point<Clock, Duration> deadline) {
+        return SendUntilImpl(value, deadline);
+    }
+
+    template <class Clock, class Duration>
+    ChannelStatus SendUntil(T&& value, std::chrono::time_point<Clock, Duration> deadline) {
+        return SendUntilImpl(std::move(value), deadline);
+    }
+
+    // RecvFor/RecvUntil block until an element arrives (kOk), the deadline passes (kTimeout) or
+    // the channel is closed and drained (kClosed).
+    template <class Rep, class Period>
+    ChannelStatus RecvFor(std::optional<T>& value, std::chrono::duration<Rep, Period> timeout) {
+        return RecvUntil(value, std::chrono::steady_clock::now() + timeout);
+    }
 
-        if (queue_.empty()) {
-            cv_recv_.wait(ul, [this]() -> bool { return !queue_.empty() || !open_; });
+    template <class Clock, class Duration>
+    ChannelStatus RecvUntil(std::optional<T>& value,
+                            std::chrono::time_point<Clock, Duration> deadline) {
+        WaitTimer timer(*this, recv_side_);
+        while (true) {
+            ChannelStatus status = TryRecv(value);
+            if (status != ChannelStatus::kEmpty) {
+                return status;
+            }
+
+            std::unique_lock<std::mutex> ul(m_);
+            auto ready = [this]() -> bool { return CanPop(); };
+            if (!ParkUntil(ul, recv_side_, deadline, timer, ready)) {
+                return ChannelStatus::kTimeout;
+            }
         }
+    }
 
-        if (queue_.empty()) {
-            return std::nullopt;
+    void Close() {
+        head_.fetch_or(kClosedBit);
+        std::vector<Resumption> ready;
+        {
+            std::unique_lock<std::mutex> ul(m_);
+            for (Side* side : {&send_side_, &recv_side_}) {
+                side->cv.notify_all();
+                for (SelectWaiter* waiter : side->selects) {
+                    waiter->Notify();
+                }
+                CompleteAsync(*side, ready);
+            }
         }
+        Resume(ready);
+    }
 
-        T value = queue_.front();
-        queue_.pop_front();
-        cv_send_.notify_one();
-        return value;
+    // Stats is only available with a stats policy enabled.
+    ChannelStats Stats() const
+        requires StatsPolicy::kEnabled
+    {
+        uint64_t current_head = head_.load(std::memory_order_relaxed) & ~kClosedBit;
+        auto depth = static_cast<int64_t>(current_head - tail_.load(std::memory_order_relaxed));
+        return stats_.Snapshot(std::clamp<int64_t>(depth, 0, capacity_));
     }
 
-    void Close() {
-        std::unique_lock<std::mutex> ul(m_);
-        open_ = false;
-        cv_recv_.notify_all();
-        cv_send_.notify_all();
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Coroutine support
+    //
+    // co_await AsyncSend(value) / co_await AsyncRecv() never block the thread. If the operation
+    // can't complete right away, the coroutine is queued in the channel and the counterpart
+    // Send/Recv (blocking or not) completes it and resumes it on executor. A suspended coroutine
+    // must not be destroyed before it is resumed.
+
+    class SendAwaiter : private AsyncOperation {
+    public:
+        SendAwaiter(BufferedChannel& channel, T value, Executor* executor)
+            : channel_(channel), value_(std::move(value)) {
+            this->executor = executor;
+        }
+
+        bool await_ready() {
+            if (!TryComplete()) {
+                return false;
+            }
+            channel_.Wake(channel_.recv_side_);
+            return true;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            this->handle = handle;
+            return channel_.Suspend(channel_.send_side_, this);
+        }
+
+        void await_resume() {
+            if (closed_) {
+                throw std::runtime_error("https://www.youtube.com/watch?v=0VTIeL9wmQE");
+            }
+        }
+
+    private:
+        bool TryComplete() override {
+            ChannelStatus status = channel_.TryPush(std::move(value_));
+            closed_ = status == ChannelStatus::kClosed;
+            return status != ChannelStatus::kFull;
+        }
+
+        BufferedChannel& channel_;
+        T value_;
+        bool closed_ = false;
+    };
+
+    class RecvAwaiter : private AsyncOperation {
+    public:
+        RecvAwaiter(BufferedChannel& channel, Executor* executor) : channel_(channel) {
+            this->executor = executor;
+        }
+
+        bool await_ready() {
+            if (!TryComplete()) {
+                return false;
+            }
+            channel_.Wake(channel_.send_side_);
+            return true;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            this->handle = handle;
+            return channel_.Suspend(channel_.recv_side_, this);
+        }
+
+        std::optional<T> await_resume() {
+            return std::move(value_);
+        }
+
+    private:
+        bool TryComplete() override {
+            return channel_.TryPop(value_) != ChannelStatus::kEmpty;
+        }
+
+        BufferedChannel& channel_;
+        std::optional<T> value_;
+    };
+
+    SendAwaiter AsyncSend(T value, Executor* executor = InlineExecutor::Instance()) {
+        return SendAwaiter(*this, std::move(value), executor);
+    }
+
+    RecvAwaiter AsyncRecv(Executor* executor = InlineExecutor::Instance()) {
+        return RecvAwaiter(*this, executor);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Select support
+
+    using ValueType = T;
+
+    void SubscribeSend(SelectWaiter* waiter) {
+        Subscribe(send_side_, waiter);
+    }
+
+    void UnsubscribeSend(SelectWaiter* waiter) {
+        Unsubscribe(send_side_, waiter);
+    }
+
+    void SubscribeRecv(SelectWaiter* waiter) {
+        Subscribe(recv_side_, waiter);
+    }
+
+    void UnsubscribeRecv(SelectWaiter* waiter) {
+        Unsubscribe(recv_side_, waiter);
     }
 
 private:
-    std::deque<T> queue_;
-    std::atomic<int> max_size_;
+    using Node = TaggedSlot<T>;
+
+    // Closed flag lives in head_, so a sender either claims a slot before Close() or sees the
+    // flag in its CAS. Receivers then know the channel is drained once tail_ catches up.
+    static constexpr uint64_t kClosedBit = uint64_t(1) << 63;
+
+    // A ring of one slot cannot tell "published at i" from "free for i + 1", hence at least two.
+    static uint64_t RoundUp(uint64_t n) {
+        uint64_t result = 2;
+        while (result < n) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    template <class... Args>
+    void SendInPlace(Args&&... args) {
+        WaitTimer timer(*this, send_side_);
+        while (true) {
+            ChannelStatus status = TryPushInPlace(std::forward<Args>(args)...);
+            if (status == ChannelStatus::kOk) {
+                Wake(recv_side_);
+                return;
+            }
+            if (status == ChannelStatus::kClosed) {
+                throw std::runtime_error("https://www.youtube.com/watch?v=0VTIeL9wmQE");
+            }
+
+            std::unique_lock<std::mutex> ul(m_);
+            Park(ul, send_side_, timer, [this]() -> bool { return CanPush(); });
+        }
+    }
+
+    template <class... Args>
+    ChannelStatus TryPush(Args&&... args) {
+        if constexpr (kEmplacesInPlace<T, Args...>) {
+            return TryPushInPlace(std::forward<Args>(args)...);
+        } else {
+            return TryPushInPlace(T(std::forward<Args>(args)...));
+        }
+    }
+
+    template <class... Args>
+    ChannelStatus TryPushInPlace(Args&&... args) {
+        uint64_t first, count;
+        ChannelStatus status = ClaimPush(1, first, count);
+        if (status == ChannelStatus::kOk) {
+            Node& node = data_[first & mask_];
+            node.Construct(std::forward<Args>(args)...);
+            node.tag.store(first + 1, std::memory_order_release);
+        }
+        return status;
+    }
+
+    ChannelStatus TryPop(std::optional<T>& value) {
+        uint64_t first, count;
+        ChannelStatus status = ClaimPop(1, first, count);
+        if (status == ChannelStatus::kOk) {
+            value.emplace(std::move(*data_[first & mask_].Get()));
+            ReleasePopped(first);
+        }
+        return status;
+    }
+
+    // ReleasePopped destroys the element of claimed slot index and frees the slot for the next lap.
+    void ReleasePopped(uint64_t index) {
+        Node& node = data_[index & mask_];
+        std::destroy_at(node.Get());
+        node.tag.store(index + data_.size(), std::memory_order_release);
+    }
+
+    template <class InputIt>
+    size_t PushMany(InputIt values, uint64_t size) {
+        WaitTimer timer(*this, send_side_);
+        while (true) {
+            uint64_t first, count;
+            ChannelStatus status = ClaimPush(size, first, count);
+            if (status == ChannelStatus::kOk) {
+                for (uint64_t i = 0; i < count; ++i, ++values) {
+                    Node& node = data_[(first + i) & mask_];
+                    node.Construct(*values);
+                    node.tag.store(first + i + 1, std::memory_order_release);
+                }
+                Wake(recv_side_, count);
+                return count;
+            }
+            if (status == ChannelStatus::kClosed) {
+                throw std::runtime_error("https://www.youtube.com/watch?v=0VTIeL9wmQE");
+            }
+
+            std::unique_lock<std::mutex> ul(m_);
+            Park(ul, send_side_, timer, [this]() -> bool { return CanPush(); });
+        }
+    }
+
+    // ClaimPush reserves up to max consecutive free slots starting at head_ with a single CAS.
+    // Claimed slots are owned by the caller until their tags are published.
+    ChannelStatus ClaimPush(uint64_t max, uint64_t& first, uint64_t& count) {
+        uint64_t current_head = head_.load(std::memory_order_relaxed);
+        while (true) {
+            if (current_head & kClosedBit) {
+                return ChannelStatus::kClosed;
+            }
+            max = std::min(max, Room(current_head));
+            count = 0;
+            uint64_t tag = 0;
+            while (count < max) {
+                tag = data_[(current_head + count) & mask_].tag.load(std::memory_order_acquire);
+                if (tag != current_head + count) {
+                    break;
+                }
+                ++count;
+            }
+            if (count == 0) {
+                if (max == 0 || tag <= current_head) {
+                    return ChannelStatus::kFull;
+                }
+                current_head = head_.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (head_.compare_exchange_weak(current_head, current_head + count,
+                                            std::memory_order_relaxed)) {
+                first = current_head;
+                if constexpr (StatsPolicy::kEnabled) {
+                    uint64_t depth = first + count - tail_.load(std::memory_order_relaxed);
+                    stats_.OnSend(count, std::min(depth, capacity_));
+                }
+                return ChannelStatus::kOk;
+            }
+        }
+    }
+
+    // ClaimPop reserves up to max consecutive published slots starting at tail_.
+    ChannelStatus ClaimPop(uint64_t max, uint64_t& first, uint64_t& count) {
+        uint64_t current_tail = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            count = 0;
+            uint64_t tag = 0;
+            while (count < max) {
+                tag = data_[(current_tail + count) & mask_].tag.load(std::memory_order_acquire);
+                if (tag != current_tail + count + 1) {
+                    break;
+                }
+                ++count;
+            }
+            if (count == 0) {
+                if (tag < current_tail + 1) {
+                    return Drained(current_tail) ? ChannelStatus::kClosed : ChannelStatus::kEmpty;
+                }
+                current_tail = tail_.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (tail_.compare_exchange_weak(current_tail, current_tail + count,
+                                            std::memory_order_relaxed)) {
+                first = current_tail;
+                stats_.OnRecv(count);
+                return ChannelStatus::kOk;
+            }
+        }
+    }
+
+    // Capacity may be smaller than the ring, so the tag check alone is not enough.
+    uint64_t Room(uint64_t current_head) const {
+        auto size = static_cast<int64_t>(current_head - tail_.load(std::memory_order_acquire));
+        return size < static_cast<int64_t>(capacity_) ? capacity_ - size : 0;
+    }
+
+    bool Drained(uint64_t current_tail) const {
+        uint64_t current_head = head_.load(std::memory_order_acquire);
+        return (current_head & kClosedBit) && (current_head & ~kClosedBit) == current_tail;
+    }
+
+    // Wait predicates: the next TryPush/TryPop has a chance to succeed.
+    bool CanPush() const {
+        uint64_t current_head = head_.load(std::memory_order_acquire);
+        if (current_head & kClosedBit) {
+            return true;
+        }
+        return data_[current_head & mask_].tag.load(std::memory_order_acquire) >= current_head &&
+               Room(current_head) > 0;
+    }
+
+    bool CanPop() const {
+        uint64_t current_tail = tail_.load(std::memory_order_acquire);
+        return data_[current_tail & mask_].tag.load(std::memory_order_acquire) >= current_tail + 1 ||
+               Drained(current_tail);
+    }
+
+    // Waiter counters are published before the predicate is rechecked under m_, and read by the
+    // other side after its ring update, so either the waiter sees the update or gets notified.
+    // Side holds everyone waiting for one direction of the channel: parked threads, subscribed
+    // Selects and suspended coroutines. The counter covers all of them, so Wake stays lock-free
+    // when it's zero.
+    struct Side {
+        std::atomic<int> waiters = 0;
+        std::condition_variable cv;
+        std::vector<SelectWaiter*> selects;
+        std::deque<AsyncOperation*> async;
+    };
+
+    using Resumption = std::pair<Executor*, std::coroutine_handle<>>;
+
+    // WaitTimer records one blocked operation with the stats policy, however many times it
+    // parks before it completes. The wait lasts from the first real park to the end of the
+    // operation, an operation that never had to sleep isn't counted at all.
+    class WaitTimer {
+    public:
+        WaitTimer(BufferedChannel& channel, Side& side)
+            : channel_(channel), send_(&side == &channel.send_side_) {
+        }
+
+        WaitTimer(const WaitTimer&) = delete;
+        WaitTimer& operator=(const WaitTimer&) = delete;
+
+        ~WaitTimer() {
+            if constexpr (StatsPolicy::kEnabled) {
+                if (parked_) {
+                    channel_.stats_.OnWait(send_, std::chrono::steady_clock::now() - start_);
+                }
+            }
+        }
+
+        void OnPark() {
+            if constexpr (StatsPolicy::kEnabled) {
+                if (!parked_) {
+                    parked_ = true;
+                    start_ = std::chrono::steady_clock::now();
+                }
+            }
+        }
+
+    private:
+        BufferedChannel& channel_;
+        bool send_;
+        bool parked_ = false;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    template <class Predicate>
+    void Park(std::unique_lock<std::mutex>& ul, Side& side, WaitTimer& timer,
+              Predicate predicate) {
+        if (predicate()) {
+            return;
+        }
+        timer.OnPark();
+        side.waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        side.cv.wait(ul, predicate);
+        side.waiters.fetch_sub(1);
+    }
+
+    // ParkUntil returns false if deadline passed before predicate held.
+    template <class Clock, class Duration, class Predicate>
+    bool ParkUntil(std::unique_lock<std::mutex>& ul, Side& side,
+                   std::chrono::time_point<Clock, Duration> deadline, WaitTimer& timer,
+                   Predicate predicate) {
+        if (predicate()) {
+            return true;
+        }
+        timer.OnPark();
+        side.waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ready = side.cv.wait_until(ul, deadline, predicate);
+        side.waiters.fetch_sub(1);
+        return ready;
+    }
+
+    template <class U>
+    ChannelStatus TrySendImpl(U&& value) {
+        ChannelStatus status = TryPush(std::forward<U>(value));
+        if (status == ChannelStatus::kOk) {
+            Wake(recv_side_);
+        }
+        return status;
+    }
+
+    template <class U, class Clock, class Duration>
+    ChannelStatus SendUntilImpl(U&& value, std::chrono::time_point<Clock, Duration> deadline) {
+        WaitTimer timer(*this, send_side_);
+        while (true) {
+            ChannelStatus status = TrySendImpl(std::forward<U>(value));
+            if (status != ChannelStatus::kFull) {
+                return status;
+            }
+
+            std::unique_lock<std::mutex> ul(m_);
+            auto ready = [this]() -> bool { return CanPush(); };
+            if (!ParkUntil(ul, send_side_, deadline, timer, ready)) {
+                return ChannelStatus::kTimeout;
+            }
+        }
+    }
+
+    // Wake notifies at most count parked threads and every subscribed Select under a single
+    // acquisition of m_. Selects just retry their cases, so waking all of them is harmless.
+    //
+    // Queued coroutines get their operation done right here, in order. That in turn frees slots
+    // or fills them for the opposite side, so the wakeup bounces between the sides until nobody
+    // else can make progress.
+    void Wake(Side& side, uint64_t count = 1) {
+        Side* current_side = &side;
+        while (true) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int current = current_side->waiters.load(std::memory_order_relaxed);
+            if (current == 0) {
+                return;
+            }
+
+            std::vector<Resumption> ready;
+            {
+                std::unique_lock<std::mutex> ul(m_);
+                if (count >= static_cast<uint64_t>(current)) {
+                    current_side->cv.notify_all();
+                } else {
+                    for (uint64_t i = 0; i < count; ++i) {
+                        current_side->cv.notify_one();
+                    }
+                }
+                for (SelectWaiter* waiter : current_side->selects) {
+                    waiter->Notify();
+                }
+                CompleteAsync(*current_side, ready);
+            }
+            if (ready.empty()) {
+                return;
+            }
+
+            Resume(ready);
+            count = ready.size();
+            current_side = current_side == &send_side_ ? &recv_side_ : &send_side_;
+        }
+    }
+
+    // CompleteAsync runs under m_. TryComplete only touches the TryPush/TryPop fast path, the
+    // coroutines themselves are resumed after m_ is released.
+    void CompleteAsync(Side& side, std::vector<Resumption>& ready) {
+        while (!side.async.empty()) {
+            AsyncOperation* operation = side.async.front();
+            if (!operation->TryComplete()) {
+                break;
+            }
+            side.async.pop_front();
+            side.waiters.fetch_sub(1);
+            ready.emplace_back(operation->executor, operation->handle);
+        }
+    }
+
+    void Resume(const std::vector<Resumption>& ready) {
+        for (auto [executor, handle] : ready) {
+            executor->Execute(handle);
+        }
+    }
+
+    // Suspend queues operation unless it completes after registering, which closes the race with
+    // a counterpart that finished right before. Returns whether the coroutine stays suspended.
+    bool Suspend(Side& side, AsyncOperation* operation) {
+        {
+            std::unique_lock<std::mutex> ul(m_);
+            side.waiters.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!operation->TryComplete()) {
+                side.async.push_back(operation);
+                return true;
+            }
+            side.waiters.fetch_sub(1);
+        }
+        Wake(&side == &send_side_ ? recv_side_ : send_side_);
+        return false;
+    }
+
+    void Subscribe(Side& side, SelectWaiter* waiter) {
+        std::unique_lock<std::mutex> ul(m_);
+        side.selects.push_back(waiter);
+        side.waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void Unsubscribe(Side& side, SelectWaiter* waiter) {
+        std::unique_lock<std::mutex> ul(m_);
+        side.selects.erase(std::find(side.selects.begin(), side.selects.end(), waiter));
+        side.waiters.fetch_sub(1);
+    }
+
+    const uint64_t capacity_;
+    std::vector<Node> data_;
+    const uint64_t mask_;
+    std::atomic<uint64_t> head_ = 0, tail_ = 0;
+
     std::mutex m_;
-    std::atomic<bool> open_;
+    Side send_side_, recv_side_;
 
-    std::condition_variable cv_send_;
-    std::condition_variable cv_recv_;
+    [[no_unique_address]] StatsPolicy stats_;
 };
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// ChannelStats is a point-in-time view of a channel's counters.
+struct ChannelStats {
+    // Wait histogram bucket i counts blocked operations that waited [2^i, 2^(i+1)) microseconds,
+    // the first bucket also takes shorter ones and the last one everything longer. An operation
+    // counts once however many times it parked.
+    static constexpr int kWaitBuckets = 24;
+
+    uint64_t depth = 0;
+    uint64_t peak_depth = 0;
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    uint64_t blocked_sends = 0;
+    uint64_t blocked_recvs = 0;
+    std::array<uint64_t, kWaitBuckets> send_waits{};
+    std::array<uint64_t, kWaitBuckets> recv_waits{};
+    std::chrono::steady_clock::duration uptime{};
+
+    // MessagesPerSecond is the receive rate since the channel was created, or since an earlier
+    // snapshot of the same channel.
+    double MessagesPerSecond() const {
+        return Rate(received, uptime);
+    }
+
+    double MessagesPerSecond(const ChannelStats& earlier) const {
+        return Rate(received - earlier.received, uptime - earlier.uptime);
+    }
+
+private:
+    static double Rate(uint64_t messages, std::chrono::duration<double> elapsed) {
+        return elapsed.count() > 0 ? messages / elapsed.count() : 0;
+    }
+};
+
+// NoChannelStats is the default stats policy of BufferedChannel, every hook compiles away.
+struct NoChannelStats {
+    static constexpr bool kEnabled = false;
+
+    void OnSend(uint64_t, uint64_t) {
+    }
+
+    void OnRecv(uint64_t) {
+    }
+
+    void OnWait(bool, std::chrono::steady_clock::duration) {
+    }
+};
+
+// ChannelCounters is the opt-in stats policy: BufferedChannel<T, ChannelCounters>.
+//
+// Message counts are bumped on every operation, so they are sharded per thread into separate
+// cache lines with relaxed increments and only summed up by Snapshot(). Peak depth is a relaxed
+// max that rarely writes, waits are only recorded on the slow path where the thread parks anyway.
+class ChannelCounters {
+public:
+    static constexpr bool kEnabled = true;
+
+    void OnSend(uint64_t count, uint64_t depth) {
+        Local().sent.fetch_add(count, std::memory_order_relaxed);
+        uint64_t peak = peak_depth_.load(std::memory_order_relaxed);
+        while (depth > peak &&
+               !peak_depth_.compare_exchange_weak(peak, depth, std::memory_order_relaxed)) {
+        }
+    }
+
+    void OnRecv(uint64_t count) {
+        Local().received.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void OnWait(bool send, std::chrono::steady_clock::duration wait) {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(wait).count();
+        int bucket = 0;
+        while (micros > 1 && bucket + 1 < ChannelStats::kWaitBuckets) {
+            micros >>= 1;
+            ++bucket;
+        }
+        (send ? blocked_sends_ : blocked_recvs_).fetch_add(1, std::memory_order_relaxed);
+        (send ? send_waits_ : recv_waits_)[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Snapshot sums the shards. Counters keep moving meanwhile, so the totals are only
+    // consistent with each other once the channel is quiet.
+    ChannelStats Snapshot(uint64_t depth) const {
+        ChannelStats stats;
+        stats.depth = depth;
+        stats.peak_depth = peak_depth_.load(std::memory_order_relaxed);
+        for (const Shard& shard : shards_) {
+            stats.sent += shard.sent.load(std::memory_order_relaxed);
+            stats.received += shard.received.load(std::memory_order_relaxed);
+        }
+        stats.blocked_sends = blocked_sends_.load(std::memory_order_relaxed);
+        stats.blocked_recvs = blocked_recvs_.load(std::memory_order_relaxed);
+        for (int i = 0; i < ChannelStats::kWaitBuckets; ++i) {
+            stats.send_waits[i] = send_waits_[i].load(std::memory_order_relaxed);
+            stats.recv_waits[i] = recv_waits_[i].load(std::memory_order_relaxed);
+        }
+        stats.uptime = std::chrono::steady_clock::now() - created_;
+        return stats;
+    }
+
+private:
+    static constexpr int kShards = 16;
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> sent = 0;
+        std::atomic<uint64_t> received = 0;
+    };
+
+    Shard& Local() {
+        static std::atomic<int> next_thread = 0;
+        thread_local int index = next_thread.fetch_add(1, std::memory_order_relaxed) % kShards;
+        return shards_[index];
+    }
+
+    std::array<Shard, kShards> shards_;
+    std::atomic<uint64_t> peak_depth_ = 0;
+    std::atomic<uint64_t> blocked_sends_ = 0, blocked_recvs_ = 0;
+    std::array<std::atomic<uint64_t>, ChannelStats::kWaitBuckets> send_waits_{}, recv_waits_{};
+    const std::chrono::steady_clock::time_point created_ = std::chrono::steady_clock::now();
+};
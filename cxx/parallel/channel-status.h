@@ -0,0 +1,8 @@
+#pragma once
+
+// ChannelStatus is the outcome of a non-blocking or deadline channel operation.
+//
+// kFull means a send found no room (no waiting receiver for UnbufferedChannel), kEmpty means a
+// receive found nothing. kClosed is returned by sends after Close() and by receives once the
+// channel is closed and drained.
+enum class ChannelStatus { kOk, kFull, kEmpty, kTimeout, kClosed };
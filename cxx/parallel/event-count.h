@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// EventCount lets a lock-free structure park threads without a mutex on the fast path.
+//
+//     auto key = event.PrepareWait();
+//     if (ready()) {
+//         event.CancelWait();
+//     } else {
+//         event.Wait(key);
+//     }
+//
+// The notifier makes its change visible and calls Notify(), which costs a fence and a load while
+// nobody waits. A waiter registers before rechecking its condition, so either it sees the change
+// or the notifier sees the waiter and bumps the epoch the waiter is about to sleep on.
+class EventCount {
+public:
+    using Key = uint32_t;
+
+    Key PrepareWait() {
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        return epoch_.load(std::memory_order_seq_cst);
+    }
+
+    void CancelWait() {
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Wait returns once the epoch moved past key, i.e. after a Notify that followed PrepareWait.
+    void Wait(Key key) {
+        while (epoch_.load(std::memory_order_acquire) == key) {
+            epoch_.wait(key, std::memory_order_acquire);
+        }
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void Notify() {
+        if (HasWaiters()) {
+            epoch_.fetch_add(1, std::memory_order_release);
+            epoch_.notify_one();
+        }
+    }
+
+    void NotifyAll() {
+        if (HasWaiters()) {
+            epoch_.fetch_add(1, std::memory_order_release);
+            epoch_.notify_all();
+        }
+    }
+
+private:
+    bool HasWaiters() const {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return waiters_.load(std::memory_order_relaxed) != 0;
+    }
+
+    std::atomic<uint32_t> epoch_ = 0;
+    std::atomic<uint32_t> waiters_ = 0;
+};
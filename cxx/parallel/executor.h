@@ -0,0 +1,38 @@
+#pragma once
+
+#include <coroutine>
+
+// Executor decides where a coroutine suspended on a channel is resumed once the counterpart
+// operation completes it.
+class Executor {
+public:
+    virtual ~Executor() = default;
+
+    virtual void Execute(std::coroutine_handle<> handle) = 0;
+};
+
+// InlineExecutor resumes the coroutine right on the thread that completed its operation.
+class InlineExecutor : public Executor {
+public:
+    void Execute(std::coroutine_handle<> handle) override {
+        handle.resume();
+    }
+
+    static InlineExecutor* Instance() {
+        static InlineExecutor executor;
+        return &executor;
+    }
+};
+
+// AsyncOperation is a channel operation of a suspended coroutine. The channel keeps it queued
+// and calls TryComplete() whenever the counterpart side makes progress, then hands the handle to
+// the executor.
+struct AsyncOperation {
+    virtual ~AsyncOperation() = default;
+
+    // TryComplete performs the operation without blocking, false means keep waiting.
+    virtual bool TryComplete() = 0;
+
+    Executor* executor = nullptr;
+    std::coroutine_handle<> handle;
+};
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// HazardPointer protects one object of a lock-free structure from being reclaimed while the
+// calling thread still reads it.
+//
+//     HazardPointer hazard;
+//     Node* node = hazard.Protect(head_);
+//     ... node stays valid until hazard is reset or destroyed ...
+//
+// A thread that unlinks an object hands it to HazardPointer::Retire instead of deleting it. The
+// object is reclaimed once no hazard pointer holds it. Retired objects are kept per thread and
+// scanned in batches, so Protect costs a store and a load, and Retire usually a push_back.
+class HazardPointer {
+public:
+    using Reclaim = void (*)(void*);
+
+    HazardPointer() : slot_(State().AcquireSlot()) {
+    }
+
+    ~HazardPointer() {
+        slot_->store(nullptr, std::memory_order_release);
+        State().ReleaseSlot(slot_);
+    }
+
+    HazardPointer(const HazardPointer&) = delete;
+    HazardPointer& operator=(const HazardPointer&) = delete;
+
+    // Protect publishes the current value of source and returns it once it is known to still be
+    // linked, i.e. source didn't change after the hazard became visible.
+    template <class T>
+    T* Protect(const std::atomic<T*>& source) {
+        T* ptr = source.load(std::memory_order_relaxed);
+        while (true) {
+            slot_->store(ptr, std::memory_order_seq_cst);
+            T* current = source.load(std::memory_order_seq_cst);
+            if (current == ptr) {
+                return ptr;
+            }
+            ptr = current;
+        }
+    }
+
+    void Reset() {
+        slot_->store(nullptr, std::memory_order_release);
+    }
+
+    // Retire calls reclaim(ptr) once no hazard pointer protects ptr. It may happen on any thread.
+    static void Retire(void* ptr, Reclaim reclaim) {
+        State().Retire({ptr, reclaim});
+    }
+
+    template <class T>
+    static void Retire(T* ptr) {
+        Retire(ptr, [](void* object) { delete static_cast<T*>(object); });
+    }
+
+private:
+    static constexpr int kSlots = 8;
+    static constexpr size_t kMinScanThreshold = 64;
+
+    // Record holds the hazards of one thread. Records are never freed, a thread exiting just
+    // gives its record to the next one.
+    struct alignas(64) Record {
+        std::atomic<const void*> slots[kSlots] = {};
+        std::atomic<bool> active = false;
+        Record* next = nullptr;
+        uint32_t used = 0;
+    };
+
+    struct Retired {
+        void* ptr;
+        Reclaim reclaim;
+    };
+
+    // Domain lives for the whole program, so exiting threads can always hand over their records
+    // and leftover retired objects.
+    struct Domain {
+        std::atomic<Record*> records = nullptr;
+        std::atomic<size_t> record_count = 0;
+        std::mutex orphans_mutex;
+        std::vector<Retired> orphans;
+
+        static Domain& Instance() {
+            static Domain* domain = new Domain;
+            return *domain;
+        }
+
+        Record* AcquireRecord() {
+            for (Record* record = records.load(std::memory_order_acquire); record;
+                 record = record->next) {
+                bool active = false;
+                if (!record->active.load(std::memory_order_relaxed) &&
+                    record->active.compare_exchange_strong(active, true)) {
+                    return record;
+                }
+            }
+            auto record = new Record;
+            record->active.store(true, std::memory_order_relaxed);
+            record->next = records.load(std::memory_order_relaxed);
+            while (!records.compare_exchange_weak(record->next, record, std::memory_order_release,
+                                                  std::memory_order_relaxed)) {
+            }
+            record_count.fetch_add(1, std::memory_order_relaxed);
+            return record;
+        }
+
+        std::vector<const void*> Hazards() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::vector<const void*> hazards;
+            for (Record* record = records.load(std::memory_order_acquire); record;
+                 record = record->next) {
+                for (auto& slot : record->slots) {
+                    if (const void* ptr = slot.load(std::memory_order_acquire)) {
+                        hazards.push_back(ptr);
+                    }
+                }
+            }
+            std::sort(hazards.begin(), hazards.end());
+            return hazards;
+        }
+    };
+
+    class ThreadState {
+    public:
+        ThreadState() : record_(Domain::Instance().AcquireRecord()) {
+        }
+
+        ~ThreadState() {
+            Scan();
+            Domain& domain = Domain::Instance();
+            if (!retired_.empty()) {
+                std::unique_lock<std::mutex> lock(domain.orphans_mutex);
+                domain.orphans.insert(domain.orphans.end(), retired_.begin(), retired_.end());
+            }
+            record_->active.store(false, std::memory_order_release);
+        }
+
+        std::atomic<const void*>* AcquireSlot() {
+            for (int i = 0; i < kSlots; ++i) {
+                if (!(record_->used & (1u << i))) {
+                    record_->used |= 1u << i;
+                    return &record_->slots[i];
+                }
+            }
+            throw std::logic_error("too many hazard pointers on one thread");
+        }
+
+        void ReleaseSlot(std::atomic<const void*>* slot) {
+            record_->used &= ~(1u << (slot - record_->slots));
+        }
+
+        void Retire(Retired retired) {
+            retired_.push_back(retired);
+            size_t threshold = 2 * kSlots * Domain::Instance().record_count.load(
+                                                std::memory_order_relaxed);
+            if (retired_.size() >= std::max(threshold, kMinScanThreshold)) {
+                Scan();
+            }
+        }
+
+    private:
+        // Scan reclaims every retired object no hazard points to. Orphans of exited threads are
+        // picked up along the way, unless another thread is busy with them.
+        void Scan() {
+            Domain& domain = Domain::Instance();
+            {
+                std::unique_lock<std::mutex> lock(domain.orphans_mutex, std::try_to_lock);
+                if (lock.owns_lock() && !domain.orphans.empty()) {
+                    retired_.insert(retired_.end(), domain.orphans.begin(), domain.orphans.end());
+                    domain.orphans.clear();
+                }
+            }
+
+            std::vector<const void*> hazards = domain.Hazards();
+            auto protected_end =
+                std::partition(retired_.begin(), retired_.end(), [&](const Retired& retired) {
+                    return std::binary_search(hazards.begin(), hazards.end(), retired.ptr);
+                });
+            // reclaim may retire more objects, so the batch leaves retired_ first.
+            std::vector<Retired> reclaimable(protected_end, retired_.end());
+            retired_.erase(protected_end, retired_.end());
+            for (const Retired& retired : reclaimable) {
+                retired.reclaim(retired.ptr);
+            }
+        }
+
+        Record* record_;
+        std::vector<Retired> retired_;
+    };
+
+    static ThreadState& State() {
+        thread_local ThreadState state;
+        return state;
+    }
+
+    std::atomic<const void*>* slot_;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+// MPSCQueueHook is the link a message embeds to travel through an IntrusiveMPSCQueue:
+//
+//     struct Message : MPSCQueueHook {
+//         ...
+//     };
+//
+// Copying a message doesn't copy its link, the copy starts out unqueued.
+struct MPSCQueueHook {
+    MPSCQueueHook() = default;
+
+    MPSCQueueHook(const MPSCQueueHook&) {
+    }
+
+    MPSCQueueHook& operator=(const MPSCQueueHook&) {
+        return *this;
+    }
+
+    std::atomic<MPSCQueueHook*> next = nullptr;
+};
+
+// IntrusiveMPSCQueue is a FIFO mailbox for many producers and one consumer (Vyukov's queue).
+//
+// The queue links the messages themselves, so it never allocates and never owns them: a message
+// must stay alive until it is popped and can be in one queue at a time. Push is a single
+// exchange plus a store and never waits. Pop never waits either, but it may return nullptr
+// while a producer is between those two steps, the message shows up on a later Pop.
+template <class T>
+class IntrusiveMPSCQueue {
+    static_assert(std::is_base_of_v<MPSCQueueHook, T>, "T must derive from MPSCQueueHook");
+
+public:
+    IntrusiveMPSCQueue() : head_(&stub_), tail_(&stub_) {
+    }
+
+    IntrusiveMPSCQueue(const IntrusiveMPSCQueue&) = delete;
+    IntrusiveMPSCQueue& operator=(const IntrusiveMPSCQueue&) = delete;
+
+    // Push appends message to the queue.
+    //
+    // Safe to call from multiple threads.
+    void Push(T* message) {
+        Link(message);
+    }
+
+    // Pop removes the oldest message, nullptr if there is none yet.
+    //
+    // Not safe to call concurrently.
+    T* Pop() {
+        MPSCQueueHook* tail = tail_;
+        MPSCQueueHook* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_) {
+            if (!next) {
+                return nullptr;
+            }
+            tail_ = tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail_ = next;
+            return static_cast<T*>(tail);
+        }
+
+        // tail is the last linked message. Unless a producer already swapped in a newer one,
+        // the stub goes behind it so tail can be handed out without losing the list end.
+        if (tail != head_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        Link(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            tail_ = next;
+            return static_cast<T*>(tail);
+        }
+        return nullptr;
+    }
+
+private:
+    void Link(MPSCQueueHook* hook) {
+        hook->next.store(nullptr, std::memory_order_relaxed);
+        MPSCQueueHook* prev = head_.exchange(hook, std::memory_order_acq_rel);
+        prev->next.store(hook, std::memory_order_release);
+    }
+
+    MPSCQueueHook stub_;
+    // Producers' end.
+    alignas(64) std::atomic<MPSCQueueHook*> head_;
+    // Consumer's end.
+    alignas(64) MPSCQueueHook* tail_;
+};
@@ -1,31 +1,86 @@
 #pragma once
 
+#include "tagged-slot.h"
+
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <queue>
 #include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-template <class T>
+// MPMCBoundedQueue is a bounded lock-free queue, max_size must be a power of two.
+//
+// Each slot carries a tag saying which lap it is free or published for, so head_ and tail_ are
+// only claimed with relaxed CASes and the release/acquire pair on the tag hands the element over.
+// head_ and tail_ sit on their own cache lines. With kPadSlots every slot gets one too, which
+// stops neighbouring producers and consumers from bouncing a line at the cost of memory.
+//
+// T must be nothrow move constructible, see TaggedSlot.
+template <class T, bool kPadSlots = false>
 class MPMCBoundedQueue {
 public:
     explicit MPMCBoundedQueue(int max_size) : data_(max_size), size_(max_size), head_(0), tail_(0) {
         for (uint64_t i = 0; i < size_; ++i) {
-            data_[i].tag = i;
+            data_[i].tag.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MPMCBoundedQueue() {
+        for (uint64_t i = tail_.load(); i != head_.load(); ++i) {
+            std::destroy_at(data_[i & (size_ - 1)].Get());
         }
     }
 
     bool Enqueue(const T& value) {
+        return Emplace(value);
+    }
+
+    bool Enqueue(T&& value) {
+        return Emplace(std::move(value));
+    }
+
+    // Emplace is Enqueue with the element built from args. Returns false when the queue is full.
+    template <class... Args>
+    bool Emplace(Args&&... args) {
+        if constexpr (kEmplacesInPlace<T, Args...>) {
+            return EmplaceInPlace(std::forward<Args>(args)...);
+        } else {
+            return EmplaceInPlace(T(std::forward<Args>(args)...));
+        }
+    }
+
+    bool Dequeue(T& data) {
+        return DequeueWith([&](T&& value) { data = std::move(value); });
+    }
+
+    // Dequeue into an optional constructs the element in place, T needs no default constructor.
+    bool Dequeue(std::optional<T>& data) {
+        return DequeueWith([&](T&& value) { data.emplace(std::move(value)); });
+    }
+
+private:
+    static constexpr size_t kCacheLine = 64;
+
+    template <class... Args>
+    bool EmplaceInPlace(Args&&... args) {
+        uint64_t current_head;
         uint64_t idx;
         while (true) {
-            uint64_t current_head = head_.load();
+            current_head = head_.load(std::memory_order_relaxed);
             idx = current_head & (size_ - 1);
-            if (data_[idx].tag != current_head) {
-                if (current_head == tail_.load() + size_) {
+            if (data_[idx].tag.load(std::memory_order_acquire) != current_head) {
+                if (current_head == tail_.load(std::memory_order_relaxed) + size_) {
                     return false;
                 } else {
                     std::this_thread::yield();
                 }
             } else {
-                if (head_.compare_exchange_weak(current_head, current_head + 1)) {
+                if (head_.compare_exchange_weak(current_head, current_head + 1,
+                                                std::memory_order_relaxed)) {
                     break;
                 } else {
                     std::this_thread::yield();
@@ -33,24 +88,27 @@ public:
                 }
             }
         }
-        data_[idx].value = value;
-        ++data_[idx].tag;
+        data_[idx].Construct(std::forward<Args>(args)...);
+        data_[idx].tag.store(current_head + 1, std::memory_order_release);
         return true;
     }
 
-    bool Dequeue(T& data) {
+    template <class Sink>
+    bool DequeueWith(Sink sink) {
+        uint64_t current_tail;
         uint64_t idx;
         while (true) {
-            uint64_t current_tail = tail_.load();
+            current_tail = tail_.load(std::memory_order_relaxed);
             idx = current_tail & (size_ - 1);
-            if (data_[idx].tag != current_tail + 1) {
-                if (current_tail == head_.load()) {
+            if (data_[idx].tag.load(std::memory_order_acquire) != current_tail + 1) {
+                if (current_tail == head_.load(std::memory_order_relaxed)) {
                     return false;
                 } else {
                     std::this_thread::yield();
                 }
             } else {
-                if (tail_.compare_exchange_weak(current_tail, current_tail + 1)) {
+                if (tail_.compare_exchange_weak(current_tail, current_tail + 1,
+                                                std::memory_order_relaxed)) {
                     break;
                 } else {
                     std::this_thread::yield();
@@ -59,18 +117,17 @@ public:
             }
         }
 
-        data = data_[idx].value;
-        data_[idx].tag += size_ - 1;
+        sink(std::move(*data_[idx].Get()));
+        std::destroy_at(data_[idx].Get());
+        data_[idx].tag.store(current_tail + size_, std::memory_order_release);
         return true;
     }
 
-private:
-    struct Node {
-        T value = T();
-        std::atomic<uint64_t> tag = 0;
-    };
+    // The second alignas keeps the natural alignment when padding is off.
+    struct alignas(kPadSlots ? kCacheLine : 1) alignas(TaggedSlot<T>) Node : TaggedSlot<T> {};
 
     std::vector<Node> data_;
     uint64_t size_;
-    std::atomic<uint64_t> head_, tail_;
+    alignas(kCacheLine) std::atomic<uint64_t> head_;
+    alignas(kCacheLine) std::atomic<uint64_t> tail_;
 };
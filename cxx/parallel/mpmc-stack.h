@@ -0,0 +1,70 @@
+#pragma once
+
+#include "hazard-pointer.h"
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+// MPMCStack is a Treiber stack that any number of threads may push to and pop from.
+//
+// Popped nodes are retired through HazardPointer instead of being deleted. A popper keeps the
+// top node protected while it reads its next pointer, so the node can't be freed under it, and
+// it can't be reused either, which rules out ABA on the head CAS.
+template <class T>
+class MPMCStack {
+public:
+    MPMCStack() = default;
+
+    MPMCStack(const MPMCStack&) = delete;
+    MPMCStack& operator=(const MPMCStack&) = delete;
+
+    ~MPMCStack() {
+        for (Node* node = head_.load(); node;) {
+            delete std::exchange(node, node->next);
+        }
+    }
+
+    void Push(const T& value) {
+        Link(new Node{value});
+    }
+
+    void Push(T&& value) {
+        Link(new Node{std::move(value)});
+    }
+
+    // Pop removes top element from the stack.
+    //
+    // Safe to call from multiple threads.
+    std::optional<T> Pop() {
+        HazardPointer hazard;
+        while (true) {
+            Node* node = hazard.Protect(head_);
+            if (!node) {
+                return std::nullopt;
+            }
+            if (head_.compare_exchange_weak(node, node->next, std::memory_order_acquire,
+                                            std::memory_order_relaxed)) {
+                std::optional<T> value(std::move(node->value));
+                hazard.Reset();
+                HazardPointer::Retire(node);
+                return value;
+            }
+        }
+    }
+
+private:
+    struct Node {
+        T value;
+        Node* next = nullptr;
+    };
+
+    void Link(Node* node) {
+        node->next = head_.load(std::memory_order_relaxed);
+        while (!head_.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+        }
+    }
+
+    std::atomic<Node*> head_ = nullptr;
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "hazard-pointer.h"
+#include "tagged-slot.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// MPMCUnboundedQueue is a lock-free MPMC queue without a capacity limit.
+//
+// Elements live in a linked list of fixed-size segments. Within a segment the slots follow the
+// MPMCBoundedQueue tag protocol, except that a segment is filled only once: when its head reaches
+// the end, producers link a fresh segment and move on, and once consumers drain it the segment is
+// retired through HazardPointer. Reclaimed segments go back to a small pool, so a steady flow
+// reuses the same few segments while memory still shrinks after a burst.
+//
+// Slots are TaggedSlots like MPMCBoundedQueue's, with the same requirements on T.
+template <class T, size_t kSegmentSize = 256>
+class MPMCUnboundedQueue {
+public:
+    // max_pooled_segments is the number of drained segments kept for reuse.
+    explicit MPMCUnboundedQueue(size_t max_pooled_segments = 4)
+        : pool_(std::make_shared<Pool>(max_pooled_segments)) {
+        Segment* segment = pool_->Get();
+        head_.store(segment, std::memory_order_relaxed);
+        tail_.store(segment, std::memory_order_relaxed);
+    }
+
+    ~MPMCUnboundedQueue() {
+        Segment* segment = head_.load();
+        while (segment) {
+            for (uint64_t i = segment->tail.load(); i != segment->head.load(); ++i) {
+                std::destroy_at(segment->slots[i].Get());
+            }
+            delete std::exchange(segment, segment->next.load());
+        }
+    }
+
+    void Enqueue(const T& value) {
+        Emplace(value);
+    }
+
+    void Enqueue(T&& value) {
+        Emplace(std::move(value));
+    }
+
+    // Emplace is Enqueue with the element built from args.
+    template <class... Args>
+    void Emplace(Args&&... args) {
+        if constexpr (kEmplacesInPlace<T, Args...>) {
+            EmplaceInPlace(std::forward<Args>(args)...);
+        } else {
+            EmplaceInPlace(T(std::forward<Args>(args)...));
+        }
+    }
+
+    bool Dequeue(T& data) {
+        HazardPointer hazard;
+        while (true) {
+            Segment* segment = hazard.Protect(head_);
+            uint64_t current_tail = segment->tail.load(std::memory_order_relaxed);
+            if (current_tail == kSegmentSize) {
+                Segment* next = segment->next.load(std::memory_order_acquire);
+                if (!next) {
+                    return false;
+                }
+                // tail_ must never point at a retired segment, so it moves first.
+                Segment* expected = segment;
+                tail_.compare_exchange_strong(expected, next);
+                expected = segment;
+                if (head_.compare_exchange_strong(expected, next)) {
+                    hazard.Reset();
+                    HazardPointer::Retire(segment, &Pool::Recycle);
+                }
+                continue;
+            }
+
+            Node& node = segment->slots[current_tail];
+            if (node.tag.load(std::memory_order_acquire) != current_tail + 1) {
+                if (current_tail == segment->head.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            if (segment->tail.compare_exchange_weak(current_tail, current_tail + 1,
+                                                    std::memory_order_relaxed)) {
+                data = std::move(*node.Get());
+                std::destroy_at(node.Get());
+                return true;
+            }
+        }
+    }
+
+private:
+    using Node = TaggedSlot<T>;
+
+    template <class... Args>
+    void EmplaceInPlace(Args&&... args) {
+        HazardPointer hazard;
+        while (true) {
+            Segment* segment = hazard.Protect(tail_);
+            uint64_t current_head = segment->head.load(std::memory_order_relaxed);
+            if (current_head == kSegmentSize) {
+                AdvanceTail(segment);
+                continue;
+            }
+            if (segment->head.compare_exchange_weak(current_head, current_head + 1,
+                                                    std::memory_order_relaxed)) {
+                Node& node = segment->slots[current_head];
+                node.Construct(std::forward<Args>(args)...);
+                node.tag.store(current_head + 1, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    class Pool;
+
+    struct Segment {
+        Segment() {
+            Reset();
+        }
+
+        void Reset() {
+            for (uint64_t i = 0; i < kSegmentSize; ++i) {
+                slots[i].tag.store(i, std::memory_order_relaxed);
+            }
+            head.store(0, std::memory_order_relaxed);
+            tail.store(0, std::memory_order_relaxed);
+            next.store(nullptr, std::memory_order_relaxed);
+        }
+
+        Node slots[kSegmentSize];
+        alignas(64) std::atomic<uint64_t> head = 0;
+        alignas(64) std::atomic<uint64_t> tail = 0;
+        std::atomic<Segment*> next = nullptr;
+        // Keeps the pool alive for a segment that is still retired when the queue is gone.
+        std::shared_ptr<Pool> pool;
+    };
+
+    class Pool : public std::enable_shared_from_this<Pool> {
+    public:
+        explicit Pool(size_t max_size) : max_size_(max_size) {
+        }
+
+        ~Pool() {
+            for (Segment* segment : free_) {
+                delete segment;
+            }
+        }
+
+        Segment* Get() {
+            Segment* segment = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (!free_.empty()) {
+                    segment = free_.back();
+                    free_.pop_back();
+                }
+            }
+            if (!segment) {
+                segment = new Segment;
+            }
+            segment->pool = this->shared_from_this();
+            return segment;
+        }
+
+        // Recycle is the reclaim callback of retired segments, they are already drained.
+        static void Recycle(void* object) {
+            auto segment = static_cast<Segment*>(object);
+            std::shared_ptr<Pool> pool = std::move(segment->pool);
+            pool->Put(segment);
+        }
+
+    private:
+        void Put(Segment* segment) {
+            segment->Reset();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (free_.size() < max_size_) {
+                    free_.push_back(segment);
+                    return;
+                }
+            }
+            delete segment;
+        }
+
+        const size_t max_size_;
+        std::mutex mutex_;
+        std::vector<Segment*> free_;
+    };
+
+    // AdvanceTail moves tail_ past a full segment, linking a new one if nobody did yet.
+    void AdvanceTail(Segment* segment) {
+        Segment* next = segment->next.load(std::memory_order_acquire);
+        if (!next) {
+            Segment* fresh = pool_->Get();
+            if (segment->next.compare_exchange_strong(next, fresh)) {
+                next = fresh;
+            } else {
+                Pool::Recycle(fresh);
+            }
+        }
+        tail_.compare_exchange_strong(segment, next);
+    }
+
+    std::shared_ptr<Pool> pool_;
+    alignas(64) std::atomic<Segment*> head_ = nullptr;
+    alignas(64) std::atomic<Segment*> tail_ = nullptr;
+};
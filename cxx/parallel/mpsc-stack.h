@@ -8,11 +8,16 @@
 template <class T>
 class MPSCStack {
 public:
+    // Up to max_pooled_nodes popped nodes are kept for reuse by Push instead of being deleted.
+    // The default 0 disables the pool.
+    explicit MPSCStack(size_t max_pooled_nodes = 0) : max_pooled_nodes_(max_pooled_nodes) {
+    }
+
     // Push adds one element to stack top.
     //
     // Safe to call from multiple threads.
     void Push(const T& value) {
-        auto node = new Node;
+        auto node = Allocate();
         node->value = value;
         while (true) {
             node->next = head_.load();
@@ -25,7 +30,7 @@ public:
 
     // Pop removes top element from the stack.
     //
-    // Not safe to call concurrently.
+    // Not safe to call concurrently, MPMCStack is the multi-consumer variant.
     std::optional<T> Pop() {
         if (head_.load() == nullptr) {
             return std::nullopt;
@@ -38,19 +43,37 @@ public:
                 }
             }
             Node* node = current_head;
-            T res = node->value;
-            delete node;
+            T res = std::move(node->value);
+            Free(node);
             return res;
         }
     }
 
-    // DequeuedAll Pop's all elements from the stack and calls cb() for each.
+    enum class Order { kLifo, kFifo };
+
+    // DequeuedAll detaches the whole stack with a single exchange and calls cb() for each
+    // element, newest first, or in push order with Order::kFifo. Elements pushed meanwhile are
+    // left for the next call. If cb throws, the element it was called with is dropped and the
+    // ones it hasn't seen are put back in their original order.
     //
     // Not safe to call concurrently with Pop()
     template <class TFn>
-    void DequeueAll(const TFn& cb) {
-        while (head_) {
-            cb(Pop().value());
+    void DequeueAll(const TFn& cb, Order order = Order::kLifo) {
+        Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+        if (order == Order::kFifo) {
+            node = Reverse(node);
+        }
+        try {
+            while (node) {
+                cb(std::move(node->value));
+                Free(std::exchange(node, node->next));
+            }
+        } catch (...) {
+            // node's value has been moved into cb already, it can't go back.
+            Node* rest = node->next;
+            Free(node);
+            PushChain(order == Order::kFifo ? Reverse(rest) : rest);
+            throw;
         }
     }
 
@@ -58,6 +81,14 @@ public:
         while (head_) {
             Pop();
         }
+        for (Node* node = free_.load(); node;) {
+            delete std::exchange(node, node->next);
+        }
+    }
+
+    // AllocationsAvoided returns how many Push'es took their node from the pool.
+    size_t AllocationsAvoided() const {
+        return allocations_avoided_.load(std::memory_order_relaxed);
     }
 
 private:
@@ -66,5 +97,72 @@ private:
         Node* next = nullptr;
     };
 
+    static Node* Reverse(Node* node) {
+        Node* reversed = nullptr;
+        while (node) {
+            Node* next = node->next;
+            node->next = reversed;
+            reversed = std::exchange(node, next);
+        }
+        return reversed;
+    }
+
+    // PushChain puts a detached chain back on top of the stack, order preserved.
+    void PushChain(Node* first) {
+        if (!first) {
+            return;
+        }
+        Node* last = first;
+        while (last->next) {
+            last = last->next;
+        }
+        last->next = head_.load();
+        while (!head_.compare_exchange_weak(last->next, first)) {
+        }
+    }
+
+    // The pool is a stack the consumer pushes to and producers pop from. Only the producer that
+    // holds free_lock_ pops, so a node can't leave and come back under a pending pop (no ABA).
+    // Producers never wait for the lock, they allocate instead.
+    Node* Allocate() {
+        if (free_.load(std::memory_order_relaxed) &&
+            !free_lock_.test_and_set(std::memory_order_acquire)) {
+            Node* node = free_.load(std::memory_order_acquire);
+            while (node &&
+                   !free_.compare_exchange_weak(node, node->next, std::memory_order_acquire)) {
+            }
+            if (node) {
+                pooled_.fetch_sub(1, std::memory_order_relaxed);
+                // Only the lock holder writes the counter.
+                allocations_avoided_.store(allocations_avoided_.load(std::memory_order_relaxed) + 1,
+                                           std::memory_order_relaxed);
+            }
+            free_lock_.clear(std::memory_order_release);
+            if (node) {
+                return node;
+            }
+        }
+        return new Node;
+    }
+
+    // Free is only called by the consumer.
+    void Free(Node* node) {
+        if (pooled_.load(std::memory_order_relaxed) >= max_pooled_nodes_) {
+            delete node;
+            return;
+        }
+        pooled_.fetch_add(1, std::memory_order_relaxed);
+        node->next = free_.load(std::memory_order_relaxed);
+        while (!free_.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+        }
+    }
+
     std::atomic<Node*> head_ = nullptr;
+
+    const size_t max_pooled_nodes_;
+    std::atomic<Node*> free_ = nullptr;
+    std::atomic_flag free_lock_;
+    std::atomic<size_t> pooled_ = 0;
+    std::atomic<size_t> allocations_avoided_ = 0;
 };
@@ -0,0 +1,337 @@
+#pragma once
+
+#include "buffered-channel.h"
+#include "channel-stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// StageStats is a point-in-time view of one pipeline stage.
+struct StageStats {
+    std::string name;
+    size_t parallelism = 0;
+    uint64_t processed = 0;
+    // Time spent inside the stage function, summed over its workers.
+    std::chrono::steady_clock::duration busy{};
+    std::chrono::steady_clock::duration uptime{};
+    // The channel feeding the stage. A queue that stays full points at the bottleneck.
+    ChannelStats input;
+
+    double ItemsPerSecond() const {
+        std::chrono::duration<double> elapsed = uptime;
+        return elapsed.count() > 0 ? processed / elapsed.count() : 0;
+    }
+
+    // Utilization is the share of the workers' time spent in the stage function, close to 1
+    // means the stage needs more parallelism.
+    double Utilization() const {
+        std::chrono::duration<double> total = uptime * parallelism;
+        return total.count() > 0 ? std::chrono::duration<double>(busy).count() / total.count() : 0;
+    }
+};
+
+// PipelineStages owns the worker threads of a pipeline. Use PipelineBuilder to make one.
+class PipelineStages {
+public:
+    // Items carry their input position through the stages, so the output can be put back in
+    // order at the end.
+    template <class T>
+    struct Item {
+        uint64_t seq;
+        T value;
+    };
+
+    template <class T>
+    using Channel = BufferedChannel<Item<T>, ChannelCounters>;
+
+    PipelineStages() = default;
+
+    PipelineStages(const PipelineStages&) = delete;
+    PipelineStages& operator=(const PipelineStages&) = delete;
+
+    ~PipelineStages() {
+        Shutdown();
+    }
+
+    // Add starts parallelism workers that map in to a new channel of capacity and returns it.
+    // The last worker to finish closes the new channel, which is how Close travels downstream.
+    template <class In, class Out, class F>
+    std::shared_ptr<Channel<Out>> Add(std::string name, size_t parallelism,
+                                      std::shared_ptr<Channel<In>> in, F fn, int capacity) {
+        auto out = std::make_shared<Channel<Out>>(capacity);
+        auto stage = std::make_unique<Stage>(std::max<size_t>(parallelism, 1));
+        stage->name = std::move(name);
+        if (stages_.empty()) {
+            close_input_ = [in] { in->Close(); };
+        }
+        stage->close_output = [out] { out->Close(); };
+        stage->input_stats = [in] { return in->Stats(); };
+
+        Stage& current = *stage;
+        stages_.push_back(std::move(stage));
+        for (size_t i = 0; i < current.workers.size(); ++i) {
+            current.threads.emplace_back([this, &current, i, in, out, fn]() mutable {
+                RunWorker(current, current.workers[i], *in, *out, fn);
+            });
+        }
+        return out;
+    }
+
+    // Shutdown closes every channel at once and joins the workers, whatever is in flight is
+    // dropped.
+    void Shutdown() {
+        if (close_input_) {
+            close_input_();
+        }
+        for (auto& stage : stages_) {
+            stage->close_output();
+        }
+        for (auto& stage : stages_) {
+            for (std::thread& thread : stage->threads) {
+                if (thread.joinable()) {
+                    thread.join();
+                }
+            }
+        }
+    }
+
+    std::vector<StageStats> Stats() const {
+        std::vector<StageStats> stats;
+        for (const auto& stage : stages_) {
+            StageStats& current = stats.emplace_back();
+            current.name = stage->name;
+            current.parallelism = stage->workers.size();
+            for (const WorkerCounters& worker : stage->workers) {
+                current.processed += worker.processed.load(std::memory_order_relaxed);
+                current.busy += std::chrono::steady_clock::duration(
+                    worker.busy.load(std::memory_order_relaxed));
+            }
+            current.uptime = std::chrono::steady_clock::now() - stage->created;
+            current.input = stage->input_stats();
+        }
+        return stats;
+    }
+
+    // RethrowError rethrows the first exception thrown by a stage function, if any.
+    void RethrowError() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    // Every worker counts into its own cache line.
+    struct alignas(64) WorkerCounters {
+        std::atomic<uint64_t> processed = 0;
+        std::atomic<std::chrono::steady_clock::rep> busy = 0;
+    };
+
+    struct Stage {
+        explicit Stage(size_t parallelism) : running(parallelism), workers(parallelism) {
+        }
+
+        std::string name;
+        std::atomic<size_t> running;
+        std::vector<WorkerCounters> workers;
+        std::vector<std::thread> threads;
+        std::chrono::steady_clock::time_point created = std::chrono::steady_clock::now();
+        std::function<void()> close_output;
+        std::function<ChannelStats()> input_stats;
+    };
+
+    template <class In, class Out, class F>
+    void RunWorker(Stage& stage, WorkerCounters& counters, Channel<In>& in, Channel<Out>& out,
+                   F& fn) {
+        while (std::optional<Item<In>> item = in.Recv()) {
+            auto start = std::chrono::steady_clock::now();
+            std::optional<Out> result;
+            try {
+                result.emplace(fn(std::move(item->value)));
+            } catch (...) {
+                Fail(std::current_exception());
+            }
+            counters.busy.fetch_add((std::chrono::steady_clock::now() - start).count(),
+                                    std::memory_order_relaxed);
+            counters.processed.fetch_add(1, std::memory_order_relaxed);
+
+            if (result) {
+                try {
+                    out.Send(Item<Out>{item->seq, std::move(*result)});
+                } catch (const std::runtime_error&) {
+                    // Output closed by Shutdown.
+                    break;
+                }
+            }
+        }
+        if (stage.running.fetch_sub(1) == 1) {
+            out.Close();
+        }
+    }
+
+    // Fail remembers the first error and closes the pipeline input, the items already inside
+    // still run to the end.
+    void Fail(std::exception_ptr error) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!error_) {
+                error_ = error;
+            }
+        }
+        close_input_();
+    }
+
+    // Set before the first worker starts, workers may call it while stages are being added.
+    std::function<void()> close_input_;
+    std::vector<std::unique_ptr<Stage>> stages_;
+    std::mutex mutex_;
+    std::exception_ptr error_;
+};
+
+// Pipeline is a chain of stages connected by BufferedChannels, see PipelineBuilder.
+//
+// Send feeds the first stage and blocks while its input channel is full, so a slow stage
+// pushes back all the way to the producer. Close ends the input: every stage finishes what it
+// has, closes its output, and Recv returns nullopt once everything came out. If a stage
+// function throws, the input is closed, the failing item is dropped and Recv rethrows the
+// exception after the rest is drained.
+//
+// Destroying a pipeline drops whatever is still in flight.
+template <class In, class Out>
+class Pipeline {
+public:
+    using Stages = PipelineStages;
+
+    Pipeline(std::unique_ptr<Stages> stages, std::shared_ptr<Stages::Channel<In>> input,
+             std::shared_ptr<Stages::Channel<Out>> output, bool keep_order)
+        : stages_(std::move(stages)),
+          input_(std::move(input)),
+          output_(std::move(output)),
+          keep_order_(keep_order) {
+    }
+
+    // Send throws std::runtime_error once the pipeline is closed.
+    void Send(In value) {
+        input_->Send({next_input_.fetch_add(1, std::memory_order_relaxed), std::move(value)});
+    }
+
+    void Close() {
+        input_->Close();
+    }
+
+    // Recv returns the next result, in input order if the pipeline keeps order.
+    std::optional<Out> Recv() {
+        if (!keep_order_) {
+            if (std::optional<Stages::Item<Out>> item = output_->Recv()) {
+                return std::move(item->value);
+            }
+            stages_->RethrowError();
+            return std::nullopt;
+        }
+
+        std::unique_lock<std::mutex> lock(reorder_mutex_);
+        while (pending_.empty() || pending_.begin()->first != next_output_) {
+            std::optional<Stages::Item<Out>> item = output_->Recv();
+            if (!item) {
+                if (pending_.empty()) {
+                    stages_->RethrowError();
+                    return std::nullopt;
+                }
+                // A failed item left a gap, skip it.
+                next_output_ = pending_.begin()->first;
+                break;
+            }
+            pending_.emplace(item->seq, std::move(item->value));
+        }
+        std::optional<Out> value(std::move(pending_.begin()->second));
+        pending_.erase(pending_.begin());
+        ++next_output_;
+        return value;
+    }
+
+    std::vector<StageStats> Stats() const {
+        return stages_->Stats();
+    }
+
+private:
+    std::unique_ptr<Stages> stages_;
+    std::shared_ptr<Stages::Channel<In>> input_;
+    std::shared_ptr<Stages::Channel<Out>> output_;
+    const bool keep_order_;
+    std::atomic<uint64_t> next_input_ = 0;
+
+    // Results that came out ahead of their turn.
+    std::mutex reorder_mutex_;
+    std::map<uint64_t, Out> pending_;
+    uint64_t next_output_ = 0;
+};
+
+// PipelineBuilder wires stages together:
+//
+//     auto pipeline = PipelineBuilder<std::string>()
+//                         .Stage("parse", 4, [](std::string line) { return Parse(line); })
+//                         .Stage("score", 2, [](Record record) { return Score(record); })
+//                         .Build(true);
+//
+// Every stage gets parallelism threads, each with its own copy of the function, and reads from
+// a BufferedChannel of the builder's capacity. Stages start running as they are added.
+template <class In, class Out = In>
+class PipelineBuilder {
+public:
+    using Stages = PipelineStages;
+
+    explicit PipelineBuilder(int capacity = 64)
+        requires std::is_same_v<In, Out>
+        : stages_(std::make_unique<Stages>()),
+          capacity_(capacity),
+          input_(std::make_shared<Stages::Channel<In>>(capacity)),
+          tail_(input_) {
+    }
+
+    template <class F>
+    auto Stage(std::string name, size_t parallelism, F fn) && {
+        using Next = std::decay_t<std::invoke_result_t<F&, Out&&>>;
+        static_assert(!std::is_void_v<Next>, "a pipeline stage has to return a value");
+        auto tail = stages_->template Add<Out, Next>(std::move(name), parallelism, tail_,
+                                                     std::move(fn), capacity_);
+        return PipelineBuilder<In, Next>(std::move(stages_), capacity_, input_, std::move(tail));
+    }
+
+    // Build finishes the pipeline. keep_order makes Recv return results in Send order, at the
+    // cost of buffering results that overtook earlier ones.
+    Pipeline<In, Out> Build(bool keep_order = false) && {
+        return Pipeline<In, Out>(std::move(stages_), input_, tail_, keep_order);
+    }
+
+private:
+    template <class, class>
+    friend class PipelineBuilder;
+
+    PipelineBuilder(std::unique_ptr<Stages> stages, int capacity,
+                    std::shared_ptr<Stages::Channel<In>> input,
+                    std::shared_ptr<Stages::Channel<Out>> tail)
+        : stages_(std::move(stages)),
+          capacity_(capacity),
+          input_(std::move(input)),
+          tail_(std::move(tail)) {
+    }
+
+    std::unique_ptr<Stages> stages_;
+    int capacity_;
+    std::shared_ptr<Stages::Channel<In>> input_;
+    std::shared_ptr<Stages::Channel<Out>> tail_;
+};
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "spin-wait.h"
+
 #include <atomic>
+#include <cstdint>
 #include <thread>
 
 struct RWSpinLock {
@@ -45,3 +48,119 @@ struct RWSpinLock {
 
     std::atomic<uint64_t> data_ = 0;
 };
+
+// FairRWSpinLock is the RWSpinLock for contended and oversubscribed use.
+//
+// Waiting threads back off exponentially for a bounded number of rounds and then sleep on the
+// state word with std::atomic::wait instead of yielding. Writers announce themselves before they
+// wait and new readers stay out while any writer is queued, so a steady stream of readers can't
+// starve a writer. Uncontended LockRead/LockWrite are a single CAS, unlocks a single RMW that
+// only wakes anyone when the state says somebody sleeps.
+class FairRWSpinLock {
+public:
+    void LockRead() {
+        uint32_t state = state_.load(std::memory_order_relaxed);
+        if (!(state & kBlocksReaders) &&
+            state_.compare_exchange_weak(state, state + kReader, std::memory_order_acquire,
+                                         std::memory_order_relaxed)) {
+            return;
+        }
+
+        Backoff backoff;
+        while (true) {
+            state = state_.load(std::memory_order_relaxed);
+            if (!(state & kBlocksReaders)) {
+                if (state_.compare_exchange_weak(state, state + kReader, std::memory_order_acquire,
+                                                 std::memory_order_relaxed)) {
+                    return;
+                }
+                continue;
+            }
+            if (backoff.Pause()) {
+                continue;
+            }
+            // The writer that unlocks next sees kReadersParked and wakes us.
+            if ((state & kReadersParked) ||
+                state_.compare_exchange_weak(state, state | kReadersParked,
+                                             std::memory_order_relaxed)) {
+                state_.wait(state | kReadersParked, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void UnlockRead() {
+        uint32_t prev = state_.fetch_sub(kReader, std::memory_order_release);
+        if ((prev & kReadersMask) == kReader && (prev & kWaitingWritersMask)) {
+            state_.notify_all();
+        }
+    }
+
+    void LockWrite() {
+        uint32_t state = 0;
+        if (state_.compare_exchange_weak(state, kWriter, std::memory_order_acquire,
+                                         std::memory_order_relaxed)) {
+            return;
+        }
+
+        state = state_.fetch_add(kWaitingWriter, std::memory_order_relaxed) + kWaitingWriter;
+        Backoff backoff;
+        while (true) {
+            if (!(state & kWriter) && !(state & kReadersMask)) {
+                if (state_.compare_exchange_weak(state, state - kWaitingWriter + kWriter,
+                                                 std::memory_order_acquire,
+                                                 std::memory_order_relaxed)) {
+                    return;
+                }
+                continue;
+            }
+            if (!backoff.Pause()) {
+                // The last reader or the writer leaving sees us counted as waiting and wakes us.
+                state_.wait(state, std::memory_order_relaxed);
+            }
+            state = state_.load(std::memory_order_relaxed);
+        }
+    }
+
+    void UnlockWrite() {
+        uint32_t prev = state_.fetch_and(~(kWriter | kReadersParked), std::memory_order_release);
+        if (prev & (kReadersParked | kWaitingWritersMask)) {
+            state_.notify_all();
+        }
+    }
+
+private:
+    // state_ layout: writer bit, parked readers flag, 14 bits of waiting writers, 16 bits of
+    // readers.
+    static constexpr uint32_t kWriter = 1;
+    static constexpr uint32_t kReadersParked = 2;
+    static constexpr uint32_t kWaitingWriter = 4;
+    static constexpr uint32_t kWaitingWritersMask = 0xfffc;
+    static constexpr uint32_t kReader = 1 << 16;
+    static constexpr uint32_t kReadersMask = 0xffff0000;
+    static constexpr uint32_t kBlocksReaders = kWriter | kWaitingWritersMask;
+
+    // Backoff doubles the pause up to kMaxPause and gives up after kRounds rounds.
+    class Backoff {
+    public:
+        bool Pause() {
+            if (rounds_ == kRounds) {
+                return false;
+            }
+            for (int i = 0; i < pause_; ++i) {
+                CpuRelax();
+            }
+            pause_ = pause_ < kMaxPause ? pause_ * 2 : pause_;
+            ++rounds_;
+            return true;
+        }
+
+    private:
+        static constexpr int kMaxPause = 64;
+        static constexpr int kRounds = 10;
+
+        int pause_ = 1;
+        int rounds_ = 0;
+    };
+
+    std::atomic<uint32_t> state_ = 0;
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include "channel-status.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// SelectWaiter is the single object a blocked Select registers with every channel it waits on.
+// Channels call Notify() when the side the waiter is subscribed to may have become ready.
+class SelectWaiter {
+public:
+    void Notify() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notified_ = true;
+        cv_.notify_one();
+    }
+
+    // WaitUntil returns false if deadline passed without a notification.
+    template <class Clock, class Duration>
+    bool WaitUntil(const std::optional<std::chrono::time_point<Clock, Duration>>& deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (deadline) {
+            if (!cv_.wait_until(lock, *deadline, [this]() -> bool { return notified_; })) {
+                return false;
+            }
+        } else {
+            cv_.wait(lock, [this]() -> bool { return notified_; });
+        }
+        notified_ = false;
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool notified_ = false;
+};
+
+// Select waits on several channel operations and fires exactly one ready case, like Go's select.
+//
+//     Select()
+//         .Recv(requests, [](std::optional<Request> request) { ... })
+//         .Send(results, result, [] { ... })
+//         .Timeout(std::chrono::milliseconds(10), [] { ... })
+//         .Run();
+//
+// A receive from a closed and drained channel is ready and passes std::nullopt, a send to a
+// closed channel throws like Send() does. Ready cases are tried starting from a rotating offset,
+// so one busy channel can't starve the others.
+//
+// An UnbufferedChannel send case is ready only while a blocking Recv() is parked on the channel,
+// so two Selects can't rendezvous with each other over an UnbufferedChannel.
+class Select {
+public:
+    template <class Channel, class F>
+    Select& Recv(Channel& channel, F callback) {
+        cases_.push_back(std::make_unique<RecvCase<Channel, F>>(channel, std::move(callback)));
+        return *this;
+    }
+
+    template <class Channel, class U, class F>
+    Select& Send(Channel& channel, U&& value, F callback) {
+        cases_.push_back(std::make_unique<SendCase<Channel, F>>(channel, std::forward<U>(value),
+                                                                std::move(callback)));
+        return *this;
+    }
+
+    // Default fires when no other case is ready right away, Run() never blocks then.
+    //
+    // A Select has at most one fallback, adding a second Default or Timeout throws
+    // std::logic_error.
+    template <class F>
+    Select& Default(F callback) {
+        SetFallback(std::move(callback));
+        return *this;
+    }
+
+    template <class Rep, class Period, class F>
+    Select& Timeout(std::chrono::duration<Rep, Period> timeout, F callback) {
+        SetFallback(std::move(callback));
+        deadline_ = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+        return *this;
+    }
+
+    // Run blocks until one case fires, calls its callback and returns the case index in the
+    // order the cases were added.
+    size_t Run() {
+        static thread_local size_t rotation = 0;
+        size_t start = rotation++;
+
+        std::optional<size_t> ready = TryAll(start);
+        if (!ready && fallback_ && !deadline_) {
+            ready = fallback_index_;
+        }
+
+        if (!ready) {
+            Subscription subscription(cases_, &waiter_);
+            while (!(ready = TryAll(start))) {
+                if (!waiter_.WaitUntil(deadline_)) {
+                    ready = TryAll(start);
+                    if (!ready) {
+                        ready = fallback_index_;
+                    }
+                    break;
+                }
+            }
+        }
+
+        if (*ready == fallback_index_ && fallback_) {
+            fallback_->Fire();
+        } else {
+            cases_[*ready]->Fire();
+        }
+        return *ready;
+    }
+
+private:
+    struct Case {
+        virtual ~Case() = default;
+
+        // TryReady performs the channel operation if it can be done without blocking.
+        virtual bool TryReady() {
+            return false;
+        }
+
+        virtual void Fire() = 0;
+
+        virtual void Subscribe(SelectWaiter*) {
+        }
+
+        virtual void Unsubscribe(SelectWaiter*) {
+        }
+    };
+
+    template <class F>
+    struct Callback : Case {
+        explicit Callback(F callback) : callback(std::move(callback)) {
+        }
+
+        void Fire() override {
+            callback();
+        }
+
+        F callback;
+    };
+
+    template <class Channel, class F>
+    struct RecvCase : Case {
+        RecvCase(Channel& channel, F callback) : channel(channel), callback(std::move(callback)) {
+        }
+
+        bool TryReady() override {
+            return channel.TryRecv(value) != ChannelStatus::kEmpty;
+        }
+
+        void Fire() override {
+            callback(std::move(value));
+        }
+
+        void Subscribe(SelectWaiter* waiter) override {
+            channel.SubscribeRecv(waiter);
+        }
+
+        void Unsubscribe(SelectWaiter* waiter) override {
+            channel.UnsubscribeRecv(waiter);
+        }
+
+        Channel& channel;
+        F callback;
+        std::optional<typename Channel::ValueType> value;
+    };
+
+    template <class Channel, class F>
+    struct SendCase : Case {
+        template <class U>
+        SendCase(Channel& channel, U&& value, F callback)
+            : channel(channel), callback(std::move(callback)), value(std::forward<U>(value)) {
+        }
+
+        bool TryReady() override {
+            ChannelStatus status = channel.TrySend(std::move(value));
+            if (status == ChannelStatus::kClosed) {
+                throw std::runtime_error("channel closed");
+            }
+            return status == ChannelStatus::kOk;
+        }
+
+        void Fire() override {
+            callback();
+        }
+
+        void Subscribe(SelectWaiter* waiter) override {
+            channel.SubscribeSend(waiter);
+        }
+
+        void Unsubscribe(SelectWaiter* waiter) override {
+            channel.UnsubscribeSend(waiter);
+        }
+
+        Channel& channel;
+        F callback;
+        typename Channel::ValueType value;
+    };
+
+    // Subscription keeps the waiter registered with every channel while Run() is blocked.
+    class Subscription {
+    public:
+        Subscription(std::vector<std::unique_ptr<Case>>& cases, SelectWaiter* waiter)
+            : cases_(cases), waiter_(waiter) {
+            for (auto& select_case : cases_) {
+                if (select_case) {
+                    select_case->Subscribe(waiter_);
+                }
+            }
+        }
+
+        ~Subscription() {
+            for (auto& select_case : cases_) {
+                if (select_case) {
+                    select_case->Unsubscribe(waiter_);
+                }
+            }
+        }
+
+    private:
+        std::vector<std::unique_ptr<Case>>& cases_;
+        SelectWaiter* waiter_;
+    };
+
+    // The fallback keeps a placeholder in cases_ so that Run() can return its index.
+    template <class F>
+    void SetFallback(F callback) {
+        if (fallback_) {
+            throw std::logic_error("Select can have only one Default or Timeout case");
+        }
+        fallback_ = std::make_unique<Callback<F>>(std::move(callback));
+        fallback_index_ = cases_.size();
+        cases_.push_back(nullptr);
+    }
+
+    std::optional<size_t> TryAll(size_t start) {
+        for (size_t i = 0; i < cases_.size(); ++i) {
+            size_t idx = (start + i) % cases_.size();
+            if (cases_[idx] && cases_[idx]->TryReady()) {
+                return idx;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::vector<std::unique_ptr<Case>> cases_;
+    std::unique_ptr<Case> fallback_;
+    size_t fallback_index_ = 0;
+    std::optional<std::chrono::steady_clock::time_point> deadline_;
+    SelectWaiter waiter_;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "rw-spinlock.h"
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// SeqLock publishes a small trivially copyable value to many readers.
+//
+// Readers never write shared memory: they read the sequence number, copy the value and check the
+// sequence didn't move, retrying only if a write overlapped. Writers are serialized by the write
+// side of an RWSpinLock and keep the sequence odd while they write. The value is stored as
+// relaxed atomic words, so a torn copy that gets thrown away is not a data race.
+template <class T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable_v<T>, "SeqLock needs a trivially copyable T");
+
+public:
+    // T only has to be trivially copyable, the default constructor needs a default-constructible T.
+    SeqLock()
+        requires std::is_default_constructible_v<T>
+        : SeqLock(T()) {
+    }
+
+    explicit SeqLock(const T& value) {
+        Write(value);
+    }
+
+    T Load() const {
+        uint64_t words[kWords];
+        while (true) {
+            uint64_t seq = seq_.load(std::memory_order_acquire);
+            if (seq & 1) {
+                CpuRelax();
+                continue;
+            }
+            for (size_t i = 0; i < kWords; ++i) {
+                words[i] = data_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == seq) {
+                break;
+            }
+        }
+        alignas(T) std::byte bytes[sizeof(T)];
+        std::memcpy(bytes, words, sizeof(T));
+        return std::bit_cast<T>(bytes);
+    }
+
+    void Store(const T& value) {
+        lock_.LockWrite();
+        Write(value);
+        lock_.UnlockWrite();
+    }
+
+    // Update stores update(current value) as one write.
+    template <class F>
+    void Update(F update) {
+        lock_.LockWrite();
+        T value = Load();
+        update(value);
+        Write(value);
+        lock_.UnlockWrite();
+    }
+
+private:
+    static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    void Write(const T& value) {
+        uint64_t words[kWords] = {};
+        std::memcpy(words, &value, sizeof(T));
+
+        uint64_t seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < kWords; ++i) {
+            data_[i].store(words[i], std::memory_order_relaxed);
+        }
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    std::atomic<uint64_t> seq_ = 0;
+    std::atomic<uint64_t> data_[kWords];
+    RWSpinLock lock_;
+};
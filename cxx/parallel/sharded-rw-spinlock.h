@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// ShardedRWSpinLock is a reader-writer spinlock for read-mostly data with many reading cores.
+//
+// Every thread counts itself as a reader in one of kShards slots, each on its own cache line, so
+// readers on different cores don't bounce a shared line. A writer raises writer_ and then sweeps
+// all slots until they drain, which makes writes cost O(kShards). Same interface as RWSpinLock.
+//
+// Readers and writers each publish first and check the other side second, both seq_cst, so one
+// of them always sees the other.
+template <size_t kShards = 64>
+class ShardedRWSpinLock {
+public:
+    void LockRead() {
+        std::atomic<uint64_t>& readers = slots_[Shard()].readers;
+        while (true) {
+            readers.fetch_add(1, std::memory_order_seq_cst);
+            if (!writer_.load(std::memory_order_seq_cst)) {
+                return;
+            }
+            readers.fetch_sub(1, std::memory_order_relaxed);
+            while (writer_.load(std::memory_order_relaxed)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void UnlockRead() {
+        slots_[Shard()].readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    void LockWrite() {
+        while (true) {
+            bool expected = false;
+            if (!writer_.load(std::memory_order_relaxed) &&
+                writer_.compare_exchange_weak(expected, true, std::memory_order_seq_cst)) {
+                break;
+            }
+            std::this_thread::yield();
+        }
+
+        for (Slot& slot : slots_) {
+            while (slot.readers.load(std::memory_order_seq_cst) != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void UnlockWrite() {
+        writer_.store(false, std::memory_order_release);
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> readers = 0;
+    };
+
+    // Shard is fixed per thread, so UnlockRead hits the slot LockRead counted in.
+    static size_t Shard() {
+        static std::atomic<size_t> next_thread = 0;
+        thread_local size_t shard = next_thread.fetch_add(1, std::memory_order_relaxed) % kShards;
+        return shard;
+    }
+
+    alignas(64) std::atomic<bool> writer_ = false;
+    std::array<Slot, kShards> slots_;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+// CpuRelax tells the core we are in a spin loop, so the sibling hyperthread gets the pipeline.
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// AdaptiveSpin is the spinning phase in front of a futex wait. The budget grows while waits get
+// satisfied by spinning and shrinks when they end up parking anyway, so a ping-pong handoff spins
+// and a slow counterpart costs a handful of iterations before the thread sleeps.
+class AdaptiveSpin {
+public:
+    // Spin returns true as soon as ready() holds, false when the budget is spent. On a single
+    // CPU the counterpart can't run while we spin, so it only checks once.
+    template <class Predicate>
+    bool Spin(Predicate ready) {
+        static const bool single_cpu = std::thread::hardware_concurrency() == 1;
+        if (single_cpu) {
+            return ready();
+        }
+        int limit = limit_.load(std::memory_order_relaxed);
+        for (int i = 0; i < limit; ++i) {
+            if (ready()) {
+                if (limit < kMaxSpins) {
+                    limit_.store(limit * 2, std::memory_order_relaxed);
+                }
+                return true;
+            }
+            CpuRelax();
+        }
+        if (limit > kMinSpins) {
+            limit_.store(limit / 2, std::memory_order_relaxed);
+        }
+        return ready();
+    }
+
+    // Wait spins, then parks on value until it is no longer equal to old.
+    template <class U>
+    void Wait(const std::atomic<U>& value, U old) {
+        if (Spin([&]() -> bool { return value.load(std::memory_order_acquire) != old; })) {
+            return;
+        }
+        while (value.load(std::memory_order_acquire) == old) {
+            value.wait(old, std::memory_order_acquire);
+        }
+    }
+
+private:
+    static constexpr int kMinSpins = 16;
+    static constexpr int kMaxSpins = 4096;
+
+    std::atomic<int> limit_ = 256;
+};
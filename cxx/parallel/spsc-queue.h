@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// SPSCQueue is a bounded queue for exactly one producer thread and one consumer thread.
+//
+// head_ is only written by the producer and tail_ only by the consumer, so nobody needs a CAS.
+// Each side also keeps a private copy of the other side's index and reloads it only when the
+// copy says the ring is full (or empty). In the steady state an operation is one element copy,
+// one release store and no shared load at all.
+template <class T>
+class SPSCQueue {
+public:
+    explicit SPSCQueue(int max_size) : data_(RoundUp(max_size)), mask_(data_.size() - 1) {
+    }
+
+    ~SPSCQueue() {
+        for (uint64_t i = tail_.load(); i != head_.load(); ++i) {
+            std::destroy_at(data_[i & mask_].Get());
+        }
+    }
+
+    bool Enqueue(const T& value) {
+        return Emplace(value);
+    }
+
+    bool Enqueue(T&& value) {
+        return Emplace(std::move(value));
+    }
+
+    // Emplace constructs the element right in its slot. The slot is published only afterwards,
+    // so a throwing constructor leaves the queue unchanged.
+    template <class... Args>
+    bool Emplace(Args&&... args) {
+        uint64_t current_head = head_.load(std::memory_order_relaxed);
+        if (Room(current_head) == 0) {
+            return false;
+        }
+        new (data_[current_head & mask_].storage) T(std::forward<Args>(args)...);
+        head_.store(current_head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Dequeue(T& value) {
+        uint64_t current_tail = tail_.load(std::memory_order_relaxed);
+        if (Available(current_tail) == 0) {
+            return false;
+        }
+        Node& node = data_[current_tail & mask_];
+        value = std::move(*node.Get());
+        std::destroy_at(node.Get());
+        tail_.store(current_tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // EnqueueMany copies as many elements from the front of values as there is room for and
+    // publishes them with a single store.
+    //
+    // Returns the number of elements enqueued.
+    size_t EnqueueMany(std::span<const T> values) {
+        uint64_t current_head = head_.load(std::memory_order_relaxed);
+        uint64_t count = std::min<uint64_t>(values.size(), Room(current_head, values.size()));
+        uint64_t i = 0;
+        try {
+            for (; i < count; ++i) {
+                new (data_[(current_head + i) & mask_].storage) T(values[i]);
+            }
+        } catch (...) {
+            for (uint64_t j = 0; j < i; ++j) {
+                std::destroy_at(data_[(current_head + j) & mask_].Get());
+            }
+            throw;
+        }
+        head_.store(current_head + count, std::memory_order_release);
+        return count;
+    }
+
+    // DequeueMany moves up to max elements to out and frees their slots with a single store.
+    // If writing to out throws, the elements taken so far are dequeued and the rest stay.
+    //
+    // Returns the number of elements dequeued.
+    template <class OutputIt>
+    size_t DequeueMany(OutputIt out, size_t max) {
+        uint64_t current_tail = tail_.load(std::memory_order_relaxed);
+        uint64_t count = std::min<uint64_t>(max, Available(current_tail, max));
+        uint64_t taken = 0;
+        try {
+            for (; taken < count; ++out) {
+                Node& node = data_[(current_tail + taken) & mask_];
+                *out = std::move(*node.Get());
+                std::destroy_at(node.Get());
+                ++taken;
+            }
+        } catch (...) {
+            tail_.store(current_tail + taken, std::memory_order_release);
+            throw;
+        }
+        tail_.store(current_tail + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    static constexpr size_t kCacheLine = 64;
+
+    struct Node {
+        alignas(T) std::byte storage[sizeof(T)];
+
+        T* Get() {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+    };
+
+    static uint64_t RoundUp(int n) {
+        uint64_t result = 1;
+        while (result < static_cast<uint64_t>(n)) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    // Room and Available refresh the cached index only when it can't satisfy wanted elements.
+    uint64_t Room(uint64_t current_head, uint64_t wanted = 1) {
+        if (data_.size() - (current_head - cached_tail_) < wanted) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+        }
+        return data_.size() - (current_head - cached_tail_);
+    }
+
+    uint64_t Available(uint64_t current_tail, uint64_t wanted = 1) {
+        if (cached_head_ - current_tail < wanted) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+        }
+        return cached_head_ - current_tail;
+    }
+
+    std::vector<Node> data_;
+    const uint64_t mask_;
+
+    // Producer's line.
+    alignas(kCacheLine) std::atomic<uint64_t> head_ = 0;
+    uint64_t cached_tail_ = 0;
+
+    // Consumer's line.
+    alignas(kCacheLine) std::atomic<uint64_t> tail_ = 0;
+    uint64_t cached_head_ = 0;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// TaggedSlot is one slot of the tag protocol shared by BufferedChannel, MPMCBoundedQueue and
+// MPMCUnboundedQueue: tag says which lap the slot is free or published for, storage holds the
+// element while it is published.
+//
+// Once a producer has claimed a slot there is no way to give it back, every consumer after it
+// waits for that tag. So nothing that may throw runs inside a claimed slot: T has to be nothrow
+// move constructible, and an element whose constructor may throw is built in a temporary before
+// the claim and then moved in, see kEmplacesInPlace.
+template <class T>
+struct TaggedSlot {
+    static_assert(std::is_nothrow_move_constructible_v<T>,
+                  "elements are moved into claimed slots, T's move constructor must not throw");
+
+    alignas(T) std::byte storage[sizeof(T)];
+    std::atomic<uint64_t> tag = 0;
+
+    T* Get() {
+        return std::launder(reinterpret_cast<T*>(storage));
+    }
+
+    template <class... Args>
+    void Construct(Args&&... args) {
+        new (storage) T(std::forward<Args>(args)...);
+    }
+};
+
+// kEmplacesInPlace tells whether T(args...) may run right in a claimed slot.
+template <class T, class... Args>
+inline constexpr bool kEmplacesInPlace = std::is_nothrow_constructible_v<T, Args&&...>;
@@ -0,0 +1,233 @@
+#pragma once
+
+#include "event-count.h"
+#include "mpmc-unbounded-queue.h"
+#include "work-stealing-deque.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// ThreadPool runs tasks on a fixed set of worker threads with work stealing.
+//
+// Every worker owns a WorkStealingDeque. Tasks submitted from a worker go to its own deque, so
+// fork-join work stays on the core that created it, tasks from outside go to a shared injection
+// queue. An idle worker takes from its deque, then from the injection queue, then steals from
+// the others, and only then parks on an EventCount. Submitting wakes a worker only if one sleeps.
+//
+// The destructor runs all tasks submitted so far and joins the workers.
+class ThreadPool {
+public:
+    // threads is clamped to at least one, a pool without workers would never run anything.
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency()) {
+        threads = std::max<size_t>(threads, 1);
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            workers_[i]->thread = std::thread([this, i] { WorkerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        stop_.store(true);
+        wakeup_.NotifyAll();
+        for (auto& worker : workers_) {
+            worker->thread.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t Size() const {
+        return workers_.size();
+    }
+
+    // Submit schedules f() and returns a future for its result or exception.
+    template <class F>
+    auto Submit(F f) -> std::future<std::invoke_result_t<F>> {
+        std::packaged_task<std::invoke_result_t<F>()> task(std::move(f));
+        auto future = task.get_future();
+        Schedule(new FunctionTask<decltype(task)>(std::move(task)));
+        return future;
+    }
+
+    // ParallelFor calls body(i) for every i in [begin, end) and returns when all calls are done.
+    // The range is split in halves on demand, down to grain iterations, and idle workers steal
+    // the halves. grain 0 picks one that gives every worker several chunks. The calling thread
+    // runs tasks while there are any and parks otherwise, so nested ParallelFor on a worker is
+    // fine. The first exception thrown by body is rethrown here once the other chunks are done.
+    template <class F>
+    void ParallelFor(size_t begin, size_t end, F body, size_t grain = 0) {
+        if (begin >= end) {
+            return;
+        }
+        if (grain == 0) {
+            grain = std::max<size_t>(1, (end - begin) / (kChunksPerWorker * workers_.size()));
+        }
+
+        ForState state(end - begin);
+        auto range = [&state, &body, grain, this](size_t from, size_t to, auto& self) -> void {
+            while (to - from > grain) {
+                size_t middle = from + (to - from) / 2;
+                Schedule(new FunctionTask([=, &self] { self(middle, to, self); }));
+                to = middle;
+            }
+            try {
+                for (size_t i = from; i < to; ++i) {
+                    body(i);
+                }
+            } catch (...) {
+                std::unique_lock<std::mutex> lock(state.mutex);
+                if (!state.error) {
+                    state.error = std::current_exception();
+                }
+            }
+            // Last touch of state and of this closure, the caller may return right after.
+            ThreadPool* pool = this;
+            if (state.remaining.fetch_sub(to - from, std::memory_order_acq_rel) == to - from) {
+                pool->for_done_.NotifyAll();
+            }
+        };
+        range(begin, end, range);
+
+        // Chunks not found here are already running somewhere, their thread finishes them.
+        auto done = [&state] { return state.remaining.load(std::memory_order_acquire) == 0; };
+        while (!done()) {
+            if (Task* task = FindTask()) {
+                Execute(task);
+                continue;
+            }
+            EventCount::Key key = for_done_.PrepareWait();
+            if (done()) {
+                for_done_.CancelWait();
+                break;
+            }
+            if (Task* task = FindTask()) {
+                for_done_.CancelWait();
+                Execute(task);
+                continue;
+            }
+            for_done_.Wait(key);
+        }
+        if (state.error) {
+            std::rethrow_exception(state.error);
+        }
+    }
+
+private:
+    static constexpr size_t kChunksPerWorker = 8;
+
+    struct Task {
+        virtual ~Task() = default;
+        virtual void Run() = 0;
+    };
+
+    template <class F>
+    struct FunctionTask : Task {
+        explicit FunctionTask(F function) : function(std::move(function)) {
+        }
+
+        void Run() override {
+            function();
+        }
+
+        F function;
+    };
+
+    struct Worker {
+        WorkStealingDeque<Task*> deque;
+        std::thread thread;
+    };
+
+    struct ForState {
+        explicit ForState(size_t count) : remaining(count) {
+        }
+
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::exception_ptr error;
+    };
+
+    void Schedule(Task* task) {
+        if (Worker* worker = current_pool_ == this ? current_worker_ : nullptr) {
+            worker->deque.Push(task);
+        } else {
+            injection_.Enqueue(task);
+        }
+        wakeup_.Notify();
+    }
+
+    static void Execute(Task* task) {
+        std::unique_ptr<Task> owned(task);
+        owned->Run();
+    }
+
+    // FindTask looks at the own deque, the injection queue and then the other workers' deques,
+    // starting at a different victim each time.
+    Task* FindTask() {
+        Worker* self = current_pool_ == this ? current_worker_ : nullptr;
+        if (self) {
+            if (auto task = self->deque.Pop()) {
+                return *task;
+            }
+        }
+        Task* task = nullptr;
+        if (injection_.Dequeue(task)) {
+            return task;
+        }
+        thread_local size_t victim = 0;
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            Worker* worker = workers_[victim++ % workers_.size()].get();
+            if (worker != self) {
+                if (auto stolen = worker->deque.Steal()) {
+                    return *stolen;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    void WorkerLoop(size_t index) {
+        current_pool_ = this;
+        current_worker_ = workers_[index].get();
+        while (true) {
+            if (Task* task = FindTask()) {
+                Execute(task);
+                continue;
+            }
+            EventCount::Key key = wakeup_.PrepareWait();
+            if (Task* task = FindTask()) {
+                wakeup_.CancelWait();
+                Execute(task);
+                continue;
+            }
+            if (stop_.load()) {
+                wakeup_.CancelWait();
+                break;
+            }
+            wakeup_.Wait(key);
+        }
+        current_pool_ = nullptr;
+        current_worker_ = nullptr;
+    }
+
+    // The pool and the worker the current thread runs, if it is a worker thread.
+    static inline thread_local ThreadPool* current_pool_ = nullptr;
+    static inline thread_local Worker* current_worker_ = nullptr;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    MPMCUnboundedQueue<Task*> injection_;
+    EventCount wakeup_;
+    // Callers of ParallelFor waiting for chunks that run on other threads.
+    EventCount for_done_;
+    std::atomic<bool> stop_ = false;
+};
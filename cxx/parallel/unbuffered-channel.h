@@ -1,58 +1,614 @@
 #pragma once
 
+#include "channel-status.h"
+#include "event-count.h"
+#include "executor.h"
+#include "select.h"
+#include "spin-wait.h"
+
 #include <utility>
 #include <optional>
-#include <condition_variable>
+#include <atomic>
+#include <cstdint>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <coroutine>
+#include <thread>
 
+// UnbufferedChannel is a rendezvous channel: Send returns once a receiver has moved the value out.
+//
+// A sender publishes an Offer pointing at its value in the atomic slot_, a receiver claims it with
+// a CAS and moves the value out. Both sides spin for a while before parking, so a handoff between
+// running threads never enters the kernel. mutex_ only guards Selects and suspended coroutines.
 template <class T>
 class UnbufferedChannel {
 public:
-    void Send(const T& value) {
-        std::unique_lock<std::mutex> lock_writer(writer_);
-        std::unique_lock<std::mutex> lock(mutex_);
+    class SendAwaiter;
 
-        message_ = &value;
+private:
+    using Resumption = std::pair<Executor*, std::coroutine_handle<>>;
 
-        cv_reader_.notify_one();
+    enum : uint32_t { kPending, kTaken, kClosed };
 
-        if (message_) {
-            cv_writer_.wait(lock, [this]() -> bool { return !message_ || !open_; });
+    struct Offer {
+        explicit Offer(T* value, SendAwaiter* async = nullptr) : value(value), async(async) {
         }
 
-        if (!open_ && message_) {
+        T* value;
+        std::atomic<uint32_t> state = kPending;
+        // Suspended sender to resume instead of notifying state.
+        SendAwaiter* async;
+        // The sender waits on timed_cv_ with a deadline, state changes under mutex_.
+        bool timed = false;
+    };
+
+public:
+    void Send(const T& value) {
+        T copy(value);
+        Send(std::move(copy));
+    }
+
+    template <class... Args>
+    void Emplace(Args&&... args) {
+        T value(std::forward<Args>(args)...);
+        Send(std::move(value));
+    }
+
+    // Send hands the receiver a pointer to value, the receiver moves it out.
+    void Send(T&& value) {
+        Offer offer(&value);
+        Offer* expected = nullptr;
+        while (!slot_.compare_exchange_weak(expected, &offer, std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+            if (expected == Closed()) {
+                throw std::runtime_error("channel closed");
+            }
+            if (expected) {
+                spin_.Wait(slot_, expected);
+            }
+            expected = nullptr;
+        }
+        slot_.notify_all();
+        Serve();
+
+        WaitCompleted(offer);
+        if (offer.state.load(std::memory_order_acquire) == kClosed) {
             throw std::runtime_error("channel closed");
         }
     }
 
     std::optional<T> Recv() {
-        std::unique_lock<std::mutex> lock_reader(reader_);
-        std::unique_lock<std::mutex> lock(mutex_);
+        Offer* offer = slot_.load(std::memory_order_acquire);
+        bool parked = false;
+        while (true) {
+            if (offer == Closed()) {
+                Unpark(parked);
+                return std::nullopt;
+            }
+            if (!offer) {
+                offer = WaitOffer(parked);
+                continue;
+            }
+            if (slot_.compare_exchange_weak(offer, nullptr, std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+                Unpark(parked);
+                std::optional<T> value;
+                Take(offer, value);
+                return value;
+            }
+        }
+    }
+
+    ChannelStatus TrySend(const T& value) {
+        T copy(value);
+        return TrySend(std::move(copy));
+    }
+
+    // TrySend succeeds only when a receiver (Recv, RecvFor/RecvUntil or a coroutine) is already
+    // waiting on the channel, it never waits for a receiver to show up. A published offer is only
+    // left in the slot while some receiver is still registered as waiting, it is withdrawn with
+    // kFull as soon as nobody is. Once claimed, the handoff waits for that receiver, which can't
+    // give up anymore. value is left untouched unless sent.
+    ChannelStatus TrySend(T&& value) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!async_receivers_.empty() && slot_.load() != Closed()) {
+                RecvAwaiter* receiver = async_receivers_.front();
+                async_receivers_.pop_front();
+                slow_waiters_.fetch_sub(1);
+                receiver->value_.emplace(std::move(value));
+                lock.unlock();
+                receiver->executor_->Execute(receiver->handle_);
+                return ChannelStatus::kOk;
+            }
+        }
+
+        Offer offer(&value);
+        Offer* expected = nullptr;
+        if (parked_receivers_.load() == 0 || !slot_.compare_exchange_strong(expected, &offer)) {
+            return slot_.load() == Closed() ? ChannelStatus::kClosed : ChannelStatus::kFull;
+        }
+        slot_.notify_all();
+        Serve();
 
-        if (!message_ && open_) {
-            cv_reader_.wait(lock, [this]() -> bool { return !open_ || message_; });
+        // The receiver seen above may have taken another sender's value in between. Every
+        // parked receiver wakes up on a non-empty slot and either claims it or leaves, so this
+        // only lasts until they get to run.
+        while (slot_.load(std::memory_order_acquire) == &offer && parked_receivers_.load() != 0) {
+            std::this_thread::yield();
+        }
+        expected = &offer;
+        if (slot_.compare_exchange_strong(expected, nullptr)) {
+            slot_.notify_all();
+            Serve();
+            return ChannelStatus::kFull;
         }
+        WaitCompleted(offer);
+        if (offer.state.load(std::memory_order_acquire) == kClosed) {
+            return ChannelStatus::kClosed;
+        }
+        return ChannelStatus::kOk;
+    }
 
-        if (!open_) {
-            return std::nullopt;
+    // TryRecv takes an offer a sender has already published.
+    ChannelStatus TryRecv(std::optional<T>& value) {
+        Offer* offer = slot_.load(std::memory_order_acquire);
+        while (true) {
+            if (offer == Closed()) {
+                return ChannelStatus::kClosed;
+            }
+            if (!offer) {
+                return ChannelStatus::kEmpty;
+            }
+            if (slot_.compare_exchange_weak(offer, nullptr, std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+                Take(offer, value);
+                return ChannelStatus::kOk;
+            }
         }
+    }
+
+    // SendFor/SendUntil wait for the slot and then for a receiver until the deadline. On
+    // kTimeout or kClosed the offer has been withdrawn and value is left untouched.
+    template <class Rep, class Period>
+    ChannelStatus SendFor(T&& value, std::chrono::duration<Rep, Period> timeout) {
+        return SendUntil(std::move(value), std::chrono::steady_clock::now() + timeout);
+    }
+
+    template <class Rep, class Period>
+    ChannelStatus SendFor(const T& value, std::chrono::duration<Rep, Period> timeout) {
+        T copy(value);
+        return SendFor(std::move(copy), timeout);
+    }
 
-        T value = *message_;
-        message_ = nullptr;
-        cv_writer_.notify_one();
-        return value;
+    template <class Clock, class Duration>
+    ChannelStatus SendUntil(const T& value, std::chrono::time_point<Clock, Duration> deadline) {
+        T copy(value);
+        return SendUntil(std::move(copy), deadline);
+    }
+
+    template <class Clock, class Duration>
+    ChannelStatus SendUntil(T&& value, std::chrono::time_point<Clock, Duration> deadline) {
+        Offer offer(&value);
+        offer.timed = true;
+        Offer* expected = nullptr;
+        while (!slot_.compare_exchange_weak(expected, &offer, std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+            if (expected == Closed()) {
+                return ChannelStatus::kClosed;
+            }
+            auto free = [this]() -> bool {
+                Offer* offer = slot_.load();
+                return !offer || offer == Closed();
+            };
+            if (expected && !WaitTimed(deadline, free)) {
+                return ChannelStatus::kTimeout;
+            }
+            expected = nullptr;
+        }
+        slot_.notify_all();
+        Serve();
+
+        auto taken = [&]() -> bool { return offer.state.load() != kPending; };
+        if (!WaitTimed(deadline, taken)) {
+            expected = &offer;
+            if (slot_.compare_exchange_strong(expected, nullptr)) {
+                slot_.notify_all();
+                Serve();
+                return ChannelStatus::kTimeout;
+            }
+            // A receiver has claimed the offer already, the handoff is about to complete.
+            std::unique_lock<std::mutex> lock(mutex_);
+            timed_cv_.wait(lock, taken);
+        }
+        return offer.state.load() == kClosed ? ChannelStatus::kClosed : ChannelStatus::kOk;
+    }
+
+    // RecvFor/RecvUntil wait until a sender shows up (kOk), the deadline passes (kTimeout) or the
+    // channel is closed (kClosed).
+    template <class Rep, class Period>
+    ChannelStatus RecvFor(std::optional<T>& value, std::chrono::duration<Rep, Period> timeout) {
+        return RecvUntil(value, std::chrono::steady_clock::now() + timeout);
+    }
+
+    template <class Clock, class Duration>
+    ChannelStatus RecvUntil(std::optional<T>& value,
+                            std::chrono::time_point<Clock, Duration> deadline) {
+        bool parked = false;
+        while (true) {
+            ChannelStatus status = TryRecv(value);
+            if (status != ChannelStatus::kEmpty) {
+                Unpark(parked);
+                return status;
+            }
+            // Counted as parked like a blocking Recv, so TrySend may hand over to it too.
+            Park(parked);
+            if (!WaitTimed(deadline, [this]() -> bool { return slot_.load() != nullptr; })) {
+                Unpark(parked);
+                return ChannelStatus::kTimeout;
+            }
+        }
     }
 
     void Close() {
-        std::unique_lock<std::mutex> lock(mutex_);
-        open_ = false;
-        cv_writer_.notify_one();
-        cv_reader_.notify_one();
+        Offer* offer = slot_.exchange(Closed());
+        slot_.notify_all();
+
+        std::vector<Resumption> ready;
+        if (offer && offer != Closed()) {
+            Complete(offer, kClosed, ready);
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            NotifySelects(send_selects_);
+            NotifySelects(recv_selects_);
+            timed_cv_.notify_all();
+            for (SendAwaiter* sender : async_senders_) {
+                sender->closed_ = true;
+                ready.emplace_back(sender->executor_, sender->handle_);
+            }
+            for (RecvAwaiter* receiver : async_receivers_) {
+                ready.emplace_back(receiver->executor_, receiver->handle_);
+            }
+            slow_waiters_.fetch_sub(async_senders_.size() + async_receivers_.size());
+            async_senders_.clear();
+            async_receivers_.clear();
+        }
+        Resume(ready);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Coroutine support
+    //
+    // co_await AsyncSend(value) / co_await AsyncRecv() park the coroutine instead of the thread.
+    // A suspended sender publishes its offer like a blocking one (or queues until the slot is
+    // free), a suspended receiver gets the value of the next offer directly. The completed
+    // coroutine is resumed on executor and must not be destroyed while suspended.
+
+    class SendAwaiter {
+    public:
+        SendAwaiter(UnbufferedChannel& channel, T value, Executor* executor)
+            : channel_(channel), value_(std::move(value)), offer_(&value_, this),
+              executor_(executor) {
+        }
+
+        bool await_ready() {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            handle_ = handle;
+            // Once the offer is published the coroutine may get resumed and destroyed on another
+            // thread, so this awaiter is not touched after that.
+            UnbufferedChannel* channel = &channel_;
+            {
+                std::unique_lock<std::mutex> lock(channel->mutex_);
+                channel->slow_waiters_.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                Offer* expected = nullptr;
+                if (!channel->slot_.compare_exchange_strong(expected, &offer_)) {
+                    if (expected == channel->Closed()) {
+                        channel->slow_waiters_.fetch_sub(1);
+                        closed_ = true;
+                        return false;
+                    }
+                    channel->async_senders_.push_back(this);
+                    return true;
+                }
+                channel->slow_waiters_.fetch_sub(1);
+            }
+            channel->slot_.notify_all();
+            channel->Serve();
+            return true;
+        }
+
+        void await_resume() {
+            if (closed_) {
+                throw std::runtime_error("channel closed");
+            }
+        }
+
+    private:
+        friend class UnbufferedChannel;
+
+        UnbufferedChannel& channel_;
+        T value_;
+        Offer offer_;
+        Executor* executor_;
+        std::coroutine_handle<> handle_;
+        bool closed_ = false;
+    };
+
+    class RecvAwaiter {
+    public:
+        RecvAwaiter(UnbufferedChannel& channel, Executor* executor)
+            : channel_(channel), executor_(executor) {
+        }
+
+        bool await_ready() {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            handle_ = handle;
+            {
+                std::unique_lock<std::mutex> lock(channel_.mutex_);
+                channel_.slow_waiters_.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                Offer* offer = channel_.slot_.load(std::memory_order_acquire);
+                while (offer && offer != channel_.Closed()) {
+                    if (channel_.slot_.compare_exchange_weak(offer, nullptr)) {
+                        break;
+                    }
+                }
+                if (!offer) {
+                    channel_.async_receivers_.push_back(this);
+                    return true;
+                }
+                channel_.slow_waiters_.fetch_sub(1);
+                if (offer == channel_.Closed()) {
+                    return false;
+                }
+                channel_.Take(offer, value_, std::move(lock));
+            }
+            return false;
+        }
+
+        std::optional<T> await_resume() {
+            return std::move(value_);
+        }
+
+    private:
+        friend class UnbufferedChannel;
+
+        UnbufferedChannel& channel_;
+        std::optional<T> value_;
+        Executor* executor_;
+        std::coroutine_handle<> handle_;
+    };
+
+    SendAwaiter AsyncSend(T value, Executor* executor = InlineExecutor::Instance()) {
+        return SendAwaiter(*this, std::move(value), executor);
+    }
+
+    RecvAwaiter AsyncRecv(Executor* executor = InlineExecutor::Instance()) {
+        return RecvAwaiter(*this, executor);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Select support
+
+    using ValueType = T;
+
+    void SubscribeSend(SelectWaiter* waiter) {
+        Subscribe(send_selects_, waiter);
+    }
+
+    void UnsubscribeSend(SelectWaiter* waiter) {
+        Unsubscribe(send_selects_, waiter);
+    }
+
+    void SubscribeRecv(SelectWaiter* waiter) {
+        Subscribe(recv_selects_, waiter);
+    }
+
+    void UnsubscribeRecv(SelectWaiter* waiter) {
+        Unsubscribe(recv_selects_, waiter);
     }
 
 private:
-    bool open_ = true;
-    std::condition_variable cv_writer_, cv_reader_;
-    std::mutex mutex_, writer_, reader_;
-    T const* message_ = nullptr;
+    Offer* Closed() {
+        return &closed_;
+    }
+
+    // WaitTimed parks on timed_cv_ until ready() or the deadline. Registering as a slow waiter
+    // makes every slot transition go through Serve(), which notifies timed_cv_.
+    template <class Clock, class Duration, class Predicate>
+    bool WaitTimed(std::chrono::time_point<Clock, Duration> deadline, Predicate ready) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        slow_waiters_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool result = timed_cv_.wait_until(lock, deadline, ready);
+        slow_waiters_.fetch_sub(1);
+        return result;
+    }
+
+    // A receiver stays counted in parked_receivers_ from its first park until it has claimed an
+    // offer or given up, so TrySend never withdraws from a receiver that is about to claim.
+    void Park(bool& parked) {
+        if (!parked) {
+            parked = true;
+            parked_receivers_.fetch_add(1);
+            Serve();
+        }
+    }
+
+    void Unpark(bool parked) {
+        if (parked) {
+            parked_receivers_.fetch_sub(1);
+        }
+    }
+
+    Offer* WaitOffer(bool& parked) {
+        Offer* offer = nullptr;
+        if (spin_.Spin([&]() -> bool { return (offer = slot_.load(std::memory_order_acquire)); })) {
+            return offer;
+        }
+
+        Park(parked);
+        while (!(offer = slot_.load(std::memory_order_acquire))) {
+            slot_.wait(nullptr, std::memory_order_acquire);
+        }
+        return offer;
+    }
+
+    // Take moves the value out of a claimed offer and completes it. The slot is free again, so
+    // a queued coroutine sender may publish next. lock, if held, is released before any
+    // coroutine is resumed.
+    void Take(Offer* offer, std::optional<T>& value,
+              std::unique_lock<std::mutex> lock = std::unique_lock<std::mutex>()) {
+        value.emplace(std::move(*offer->value));
+        if (lock.owns_lock()) {
+            lock.unlock();
+        }
+        std::vector<Resumption> ready;
+        Complete(offer, kTaken, ready);
+        slot_.notify_all();
+        Serve();
+        Resume(ready);
+    }
+
+    // WaitCompleted blocks the sender of offer until a receiver or Close() completes it. The
+    // offer lives on the sender's stack, so the sender parks on the channel-owned completed_
+    // rather than on offer.state.
+    void WaitCompleted(Offer& offer) {
+        auto completed = [&]() -> bool {
+            return offer.state.load(std::memory_order_acquire) != kPending;
+        };
+        if (spin_.Spin(completed)) {
+            return;
+        }
+        while (true) {
+            EventCount::Key key = completed_.PrepareWait();
+            if (completed()) {
+                completed_.CancelWait();
+                return;
+            }
+            completed_.Wait(key);
+        }
+    }
+
+    // Complete releases the sender of offer, mutex_ must not be held. A blocking sender may
+    // return and destroy offer right after the store, so offer is not touched after it.
+    void Complete(Offer* offer, uint32_t state, std::vector<Resumption>& ready) {
+        if (offer->async) {
+            SendAwaiter* sender = offer->async;
+            sender->closed_ = state == kClosed;
+            ready.emplace_back(sender->executor_, sender->handle_);
+        } else if (offer->timed) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                offer->state.store(state, std::memory_order_release);
+            }
+            timed_cv_.notify_all();
+        } else {
+            offer->state.store(state, std::memory_order_release);
+            completed_.NotifyAll();
+        }
+    }
+
+    void Resume(const std::vector<Resumption>& ready) {
+        for (auto [executor, handle] : ready) {
+            executor->Execute(handle);
+        }
+    }
+
+    // Serve matches the slot against suspended coroutines and pokes Selects. It is called after
+    // every slot transition, but only takes mutex_ while someone slow is registered.
+    void Serve() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (slow_waiters_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+
+        std::vector<Resumption> ready;
+        std::vector<Offer*> taken;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            NotifySelects(send_selects_);
+            NotifySelects(recv_selects_);
+            timed_cv_.notify_all();
+
+            bool progress = true;
+            while (progress) {
+                progress = false;
+                Offer* offer = slot_.load(std::memory_order_acquire);
+                if (!offer && !async_senders_.empty()) {
+                    SendAwaiter* sender = async_senders_.front();
+                    if (slot_.compare_exchange_strong(offer, &sender->offer_)) {
+                        async_senders_.pop_front();
+                        slow_waiters_.fetch_sub(1);
+                        offer = &sender->offer_;
+                        progress = true;
+                    }
+                }
+                if (offer && offer != Closed() && !async_receivers_.empty()) {
+                    if (slot_.compare_exchange_strong(offer, nullptr)) {
+                        RecvAwaiter* receiver = async_receivers_.front();
+                        async_receivers_.pop_front();
+                        slow_waiters_.fetch_sub(1);
+                        receiver->value_.emplace(std::move(*offer->value));
+                        taken.push_back(offer);
+                        ready.emplace_back(receiver->executor_, receiver->handle_);
+                        progress = true;
+                    }
+                }
+            }
+        }
+        for (Offer* offer : taken) {
+            Complete(offer, kTaken, ready);
+        }
+        slot_.notify_all();
+        Resume(ready);
+    }
+
+    void Subscribe(std::vector<SelectWaiter*>& selects, SelectWaiter* waiter) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        selects.push_back(waiter);
+        slow_waiters_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void Unsubscribe(std::vector<SelectWaiter*>& selects, SelectWaiter* waiter) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        selects.erase(std::find(selects.begin(), selects.end(), waiter));
+        slow_waiters_.fetch_sub(1);
+    }
+
+    void NotifySelects(const std::vector<SelectWaiter*>& selects) {
+        for (SelectWaiter* waiter : selects) {
+            waiter->Notify();
+        }
+    }
+
+    std::atomic<Offer*> slot_ = nullptr;
+    Offer closed_{nullptr};
+    std::atomic<int> parked_receivers_ = 0;
+    AdaptiveSpin spin_;
+    // Parked blocking senders, woken whenever some offer is completed.
+    EventCount completed_;
+
+    std::mutex mutex_;
+    std::atomic<int> slow_waiters_ = 0;
+    std::condition_variable timed_cv_;
+    std::vector<SelectWaiter*> send_selects_, recv_selects_;
+    std::deque<SendAwaiter*> async_senders_;
+    std::deque<RecvAwaiter*> async_receivers_;
 };
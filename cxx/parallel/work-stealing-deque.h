@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+// WorkStealingDeque is a Chase-Lev deque: the owner thread pushes and pops at the bottom like a
+// stack, any other thread may steal from the top.
+//
+// The owner's Push/Pop only synchronize with thieves when the deque is about to run empty, a
+// steal is a CAS on top_. The ring grows on demand. Retired rings are kept until the deque dies,
+// because a thief may still be reading the old one.
+template <class T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable_v<T>, "WorkStealingDeque stores T in atomics");
+
+public:
+    explicit WorkStealingDeque(int64_t capacity = 1024) {
+        int64_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        rings_.push_back(std::make_unique<Ring>(size));
+        ring_.store(rings_.back().get(), std::memory_order_relaxed);
+    }
+
+    // Push adds value at the bottom. Owner only.
+    void Push(T value) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        if (bottom - top > ring->mask) {
+            ring = Grow(ring, top, bottom);
+        }
+        ring->Put(bottom, value);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    // Pop takes the most recently pushed value. Owner only.
+    std::optional<T> Pop() {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        std::optional<T> value = ring->Get(bottom);
+        if (top == bottom) {
+            // The last element, thieves may race for it.
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+                value.reset();
+            }
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return value;
+    }
+
+    // Steal takes the oldest value. Safe to call from any thread, fails spuriously under
+    // contention.
+    std::optional<T> Steal() {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return std::nullopt;
+        }
+        T value = ring_.load(std::memory_order_acquire)->Get(top);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    bool Empty() const {
+        return top_.load(std::memory_order_relaxed) >= bottom_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Ring {
+        explicit Ring(int64_t size) : mask(size - 1), slots(new std::atomic<T>[size]) {
+        }
+
+        // Slots are release/acquire so a thief that reads a pointer also sees what it points to.
+        T Get(int64_t index) const {
+            return slots[index & mask].load(std::memory_order_acquire);
+        }
+
+        void Put(int64_t index, T value) {
+            slots[index & mask].store(value, std::memory_order_release);
+        }
+
+        const int64_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+    };
+
+    Ring* Grow(Ring* ring, int64_t top, int64_t bottom) {
+        auto grown = std::make_unique<Ring>(2 * (ring->mask + 1));
+        for (int64_t i = top; i < bottom; ++i) {
+            grown->Put(i, ring->Get(i));
+        }
+        rings_.push_back(std::move(grown));
+        ring_.store(rings_.back().get(), std::memory_order_release);
+        return rings_.back().get();
+    }
+
+    alignas(64) std::atomic<int64_t> top_ = 0;
+    alignas(64) std::atomic<int64_t> bottom_ = 0;
+    std::atomic<Ring*> ring_;
+    // Owner only.
+    std::vector<std::unique_ptr<Ring>> rings_;
+};
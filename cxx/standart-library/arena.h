@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+
+// MonotonicArena hands out memory by bumping a pointer through chunks that double in size.
+// Deallocate does nothing, everything is freed at once by Release() or the destructor, so
+// containers built on it cost no free() per element.
+//
+// An optional initial buffer (e.g. on the stack) is used before any chunk is allocated.
+class MonotonicArena {
+public:
+    explicit MonotonicArena(size_t chunk_size = 4096)
+        : initial_chunk_size_(chunk_size), next_chunk_size_(chunk_size) {
+    }
+
+    MonotonicArena(void* buffer, size_t size, size_t chunk_size = 4096)
+        : buffer_(static_cast<char*>(buffer)),
+          buffer_size_(size),
+          cur_(buffer_),
+          end_(buffer_ + size),
+          initial_chunk_size_(chunk_size),
+          next_chunk_size_(chunk_size) {
+    }
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    ~MonotonicArena() {
+        Release();
+    }
+
+    void* Allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+        size_t space = end_ - cur_;
+        void* ptr = cur_;
+        if (!cur_ || !std::align(align, bytes, ptr, space)) {
+            AddChunk(bytes + align);
+            space = end_ - cur_;
+            ptr = cur_;
+            std::align(align, bytes, ptr, space);
+        }
+        cur_ = static_cast<char*>(ptr) + bytes;
+        return ptr;
+    }
+
+    void Deallocate(void*, size_t, size_t = alignof(std::max_align_t)) {
+    }
+
+    // Release frees every chunk. Everything allocated from the arena is gone after this, and
+    // chunk sizes start over from the constructor's chunk_size.
+    void Release() {
+        while (chunks_) {
+            operator delete(std::exchange(chunks_, chunks_->prev));
+        }
+        cur_ = buffer_;
+        end_ = buffer_ + buffer_size_;
+        next_chunk_size_ = initial_chunk_size_;
+    }
+
+private:
+    struct Chunk {
+        Chunk* prev;
+    };
+
+    void AddChunk(size_t bytes) {
+        size_t size = std::max(next_chunk_size_, bytes + sizeof(Chunk));
+        auto* chunk = static_cast<Chunk*>(operator new(size));
+        chunk->prev = chunks_;
+        chunks_ = chunk;
+        cur_ = reinterpret_cast<char*>(chunk + 1);
+        end_ = reinterpret_cast<char*>(chunk) + size;
+        next_chunk_size_ = size * 2;
+    }
+
+    char* buffer_ = nullptr;
+    size_t buffer_size_ = 0;
+    char* cur_ = nullptr;
+    char* end_ = nullptr;
+    const size_t initial_chunk_size_;
+    size_t next_chunk_size_;
+    Chunk* chunks_ = nullptr;
+};
+
+// PoolResource recycles freed blocks through free lists, one per power-of-two size class up to
+// kMaxBlock bytes, and carves new blocks out of its own MonotonicArena. That suits node-based
+// containers like List that allocate and free one node at a time. Bigger requests come from
+// the arena and are only reclaimed by Release().
+class PoolResource {
+public:
+    static constexpr size_t kMaxBlock = 512;
+
+    explicit PoolResource(size_t chunk_size = 4096) : arena_(chunk_size) {
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    void* Allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+        size_t index = SizeClass(bytes, align);
+        if (index == kClasses) {
+            return arena_.Allocate(bytes, align);
+        }
+        if (FreeBlock* block = free_[index]) {
+            free_[index] = block->next;
+            return block;
+        }
+        size_t size = kMinBlock << index;
+        return arena_.Allocate(size, std::min(size, alignof(std::max_align_t)));
+    }
+
+    void Deallocate(void* ptr, size_t bytes, size_t align = alignof(std::max_align_t)) {
+        size_t index = SizeClass(bytes, align);
+        if (index < kClasses) {
+            free_[index] = new (ptr) FreeBlock{free_[index]};
+        }
+    }
+
+    void Release() {
+        arena_.Release();
+        std::fill(std::begin(free_), std::end(free_), nullptr);
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static constexpr size_t kMinBlock = sizeof(FreeBlock);
+    static constexpr size_t kClasses = 7;  // 8 .. 512 bytes
+    static_assert(kMinBlock << (kClasses - 1) == kMaxBlock);
+
+    // SizeClass is kClasses for blocks served straight from the arena: too big or over-aligned.
+    static size_t SizeClass(size_t bytes, size_t align) {
+        if (align > alignof(std::max_align_t)) {
+            return kClasses;
+        }
+        bytes = std::max(bytes, align);
+        size_t index = 0;
+        while (index < kClasses && (kMinBlock << index) < bytes) {
+            ++index;
+        }
+        return index;
+    }
+
+    MonotonicArena arena_;
+    FreeBlock* free_[kClasses] = {};
+};
+
+// ArenaAllocator is a standard allocator that takes memory from a MonotonicArena or a
+// PoolResource, e.g. Vector<int, ArenaAllocator<int>> v(&arena). The resource must outlive
+// every container using it.
+template <typename T, typename Resource = MonotonicArena>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    ArenaAllocator(Resource* resource) noexcept : resource_(resource) {
+    }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U, Resource>& other) noexcept
+        : resource_(other.resource()) {
+    }
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(resource_->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        resource_->Deallocate(ptr, n * sizeof(T), alignof(T));
+    }
+
+    Resource* resource() const {
+        return resource_;
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U, Resource>& other) const {
+        return resource_ == other.resource();
+    }
+
+private:
+    Resource* resource_;
+};
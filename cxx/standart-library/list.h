@@ -1,71 +1,66 @@
+#pragma once
+
 #include <iostream>
 #include <memory>
-#include <list>
+#include <utility>
 
-template <typename T>
+// List stores each value inline in its node and gets the nodes from Allocator, rebound to
+// Node. With ArenaAllocator over a PoolResource freed nodes are reused, over a MonotonicArena
+// they all go away with the arena.
+template <typename T, typename Allocator = std::allocator<T>>
 class List {
+    struct NodeBase {
+        NodeBase* next;
+        NodeBase* prev;
+    };
+
 public:
-    List() : head_(new Node), tail_(head_.get()), size_(0) {
-        head_->next.reset();
-        head_->prev = nullptr;
+    struct Node : NodeBase {
+        T value;
+    };
+
+    explicit List(const Allocator& alloc = Allocator()) : alloc_(alloc), size_(0) {
+        end_.next = &end_;
+        end_.prev = &end_;
     }
 
+    List(const List&) = delete;
+
     ~List() {
+        while (size_ > 0)
+            pop_back();
     }
 
     void push_back(const T& x) {
-        Node* node = new Node;
-        node->value = std::make_unique<T>(x);
-
-        node->prev = tail_->prev;
-        tail_->prev = node;
-
-        std::unique_ptr<Node>& prev = node->prev ? node->prev->next : head_;
-
-        node->next.reset(prev.release());
-        prev.reset(node);
-        ++size_;
+        Link(end_.prev, MakeNode(x));
     }
 
     void push_front(const T& x) {
-        Node* node = new Node;
-        node->value = std::make_unique<T>(x);
-        node->prev = nullptr;
-        head_->prev = node;
-        node->next.reset(head_.release());
-        head_.reset(node);
-        ++size_;
+        Link(&end_, MakeNode(x));
     }
 
     void pop_back() {
-        std::unique_ptr<Node>& prev = tail_->prev->prev ? tail_->prev->prev->next : head_;
-        std::unique_ptr<Node> node(prev.release());
-        prev.reset(node->next.release());
-        tail_->prev = node->prev;
-        --size_;
+        FreeNode(Unlink(end_.prev));
     }
 
     void pop_front() {
-        head_.reset(head_->next.release());
-        head_->prev = nullptr;
-        --size_;
+        FreeNode(Unlink(end_.next));
     }
 
-
     T& front() {
-        return *head_->value;
+        return static_cast<Node*>(end_.next)->value;
     }
 
     T& back() {
-        return *tail_->prev->value;
+        return static_cast<Node*>(end_.prev)->value;
     }
 
     auto begin() {
-        return Iterator(head_);
+        return Iterator(end_.next);
     }
 
     auto end() {
-        return Iterator(tail_);
+        return Iterator(&end_);
     }
 
     List& operator=(List& l) {
@@ -80,15 +75,44 @@ public:
         return size_;
     }
 
-    struct Node {
-        std::unique_ptr<Node> next;
-        Node* prev;
-        std::unique_ptr<T> value;
-    };
-
 private:
-    std::unique_ptr<Node> head_;
-    Node* tail_;
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+    Node* MakeNode(const T& x) {
+        Node* node = NodeTraits::allocate(alloc_, 1);
+        try {
+            new (&node->value) T(x);
+        } catch (...) {
+            NodeTraits::deallocate(alloc_, node, 1);
+            throw;
+        }
+        return node;
+    }
+
+    void FreeNode(Node* node) {
+        std::destroy_at(&node->value);
+        NodeTraits::deallocate(alloc_, node, 1);
+    }
+
+    // Link puts node right after prev.
+    void Link(NodeBase* prev, Node* node) {
+        node->prev = prev;
+        node->next = prev->next;
+        prev->next->prev = node;
+        prev->next = node;
+        ++size_;
+    }
+
+    Node* Unlink(NodeBase* node) {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        --size_;
+        return static_cast<Node*>(node);
+    }
+
+    [[no_unique_address]] NodeAllocator alloc_;
+    NodeBase end_;
     size_t size_;
 
     class Iterator {
@@ -96,18 +120,15 @@ private:
         Iterator() : node_(nullptr) {
         }
 
-        Iterator(Node*& node) : node_(node) {
-        }
-
-        Iterator(std::unique_ptr<Node>& node) : node_(node.get()) {
+        Iterator(NodeBase* node) : node_(node) {
         }
 
         T& operator*() {
-            return *node_->value;
+            return static_cast<Node*>(node_)->value;
         }
 
         Iterator& operator++() {
-            node_ = node_->next.get();
+            node_ = node_->next;
             return *this;
         }
 
@@ -125,6 +146,6 @@ private:
         }
 
     private:
-        Node* node_;
+        NodeBase* node_;
     };
 };
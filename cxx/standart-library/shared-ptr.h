@@ -1,6 +1,7 @@
 #pragma once
 
 #include "sw_fwd.h"  // Forward declaration
+#include "trivially-relocatable.h"
 
 #include <cstddef>  // std::nullptr_t
 #include <utility>
@@ -332,3 +333,6 @@ SharedPtr<T> MakeShared(Args&&... args) {
     return sp;
 }
 
+// SharedPtr is a pair of pointers, the control block doesn't know where it lives.
+template <typename T>
+struct IsTriviallyRelocatable<SharedPtr<T>> : std::true_type {};
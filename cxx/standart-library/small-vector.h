@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+// SmallVector has the interface of Vector, but keeps up to N elements in a buffer inside the
+// object and only goes to the heap when it outgrows it. Once on the heap it stays there.
+//
+// Moving a SmallVector that is still inline moves its elements one by one, a heap buffer is
+// just handed over.
+template <typename T, size_t N>
+class SmallVector {
+    static_assert(N > 0, "use Vector for N = 0");
+
+public:
+    SmallVector() = default;
+
+    explicit SmallVector(size_t n) {
+        reserve(n);
+        std::uninitialized_value_construct_n(buf_, n);
+        size_ = n;
+    }
+
+    SmallVector(const SmallVector& other) {
+        reserve(other.size_);
+        std::uninitialized_copy_n(other.buf_, other.size_, buf_);
+        size_ = other.size_;
+    }
+
+    SmallVector(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        Steal(other);
+    }
+
+    SmallVector& operator=(const SmallVector& other) {
+        if (this == &other) {
+            return *this;
+        }
+        if (other.size_ > capacity_) {
+            SmallVector tmp(other);
+            swap(tmp);
+        } else {
+            for (size_t i = 0; i < std::min(size_, other.size_); ++i) {
+                buf_[i] = other[i];
+            }
+            if (size_ < other.size_) {
+                std::uninitialized_copy_n(other.buf_ + size_, other.size_ - size_, buf_ + size_);
+            } else if (size_ > other.size_) {
+                std::destroy_n(buf_ + other.size_, size_ - other.size_);
+            }
+            size_ = other.size_;
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        if (this != &other) {
+            Release();
+            Steal(other);
+        }
+        return *this;
+    }
+
+    ~SmallVector() {
+        Release();
+    }
+
+    void reserve(size_t n) {
+        if (n > capacity_) {
+            T* new_buf = Allocate(n);
+            try {
+                std::uninitialized_move_n(buf_, size_, new_buf);
+            } catch (...) {
+                operator delete(new_buf);
+                throw;
+            }
+            Adopt(new_buf, n);
+        }
+    }
+
+    void resize(size_t n) {
+        reserve(n);
+        if (size_ < n) {
+            std::uninitialized_value_construct_n(buf_ + size_, n - size_);
+        } else if (size_ > n) {
+            std::destroy_n(buf_ + n, size_ - n);
+        }
+        size_ = n;
+    }
+
+    void push_back(const T& elem) {
+        emplace_back(elem);
+    }
+
+    void push_back(T&& elem) {
+        emplace_back(std::move(elem));
+    }
+
+    // emplace_back builds the new element before the old ones move, so args may refer to an
+    // element of the vector itself.
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (size_ < capacity_) {
+            new (buf_ + size_) T(std::forward<Args>(args)...);
+        } else {
+            size_t new_capacity = capacity_ * 2;
+            T* new_buf = Allocate(new_capacity);
+            bool built = false;
+            try {
+                new (new_buf + size_) T(std::forward<Args>(args)...);
+                built = true;
+                std::uninitialized_move_n(buf_, size_, new_buf);
+            } catch (...) {
+                if (built) {
+                    std::destroy_at(new_buf + size_);
+                }
+                operator delete(new_buf);
+                throw;
+            }
+            Adopt(new_buf, new_capacity);
+        }
+        return buf_[size_++];
+    }
+
+    void pop_back() {
+        std::destroy_at(buf_ + size_ - 1);
+        --size_;
+    }
+
+    void swap(SmallVector& other) {
+        if (!IsInline() && !other.IsInline()) {
+            std::swap(buf_, other.buf_);
+            std::swap(size_, other.size_);
+            std::swap(capacity_, other.capacity_);
+        } else {
+            SmallVector tmp(std::move(other));
+            other = std::move(*this);
+            *this = std::move(tmp);
+        }
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    // IsInline is true while the elements live inside the object.
+    bool IsInline() const {
+        return buf_ == Inline();
+    }
+
+    const T& operator[](size_t idx) const {
+        return buf_[idx];
+    }
+
+    T& operator[](size_t idx) {
+        return buf_[idx];
+    }
+
+    T* begin() const {
+        return buf_;
+    }
+
+    T* end() const {
+        return buf_ + size_;
+    }
+
+    void clear() {
+        std::destroy_n(buf_, size_);
+        size_ = 0;
+    }
+
+private:
+    static T* Allocate(size_t n) {
+        return reinterpret_cast<T*>(operator new(n * sizeof(T)));
+    }
+
+    T* Inline() const {
+        return reinterpret_cast<T*>(const_cast<unsigned char*>(inline_));
+    }
+
+    void Deallocate() {
+        if (!IsInline()) {
+            operator delete(buf_);
+        }
+    }
+
+    // Adopt switches to new_buf, which already holds the moved elements, and frees the old ones.
+    void Adopt(T* new_buf, size_t new_capacity) {
+        std::destroy_n(buf_, size_);
+        Deallocate();
+        buf_ = new_buf;
+        capacity_ = new_capacity;
+    }
+
+    // Release destroys the elements and frees the heap buffer, leaving an empty inline vector.
+    void Release() {
+        std::destroy_n(buf_, size_);
+        Deallocate();
+        buf_ = Inline();
+        size_ = 0;
+        capacity_ = N;
+    }
+
+    // Steal takes other's elements, this must be empty and inline. other ends up that way too.
+    void Steal(SmallVector& other) {
+        if (other.IsInline()) {
+            std::uninitialized_move_n(other.buf_, other.size_, buf_);
+            size_ = other.size_;
+            other.clear();
+        } else {
+            buf_ = std::exchange(other.buf_, other.Inline());
+            size_ = std::exchange(other.size_, 0);
+            capacity_ = std::exchange(other.capacity_, N);
+        }
+    }
+
+    alignas(T) unsigned char inline_[N * sizeof(T)];
+    T* buf_ = Inline();
+    size_t size_ = 0;
+    size_t capacity_ = N;
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <type_traits>
+
+// IsTriviallyRelocatable says that moving a T to a new address and ending the old object's
+// lifetime can be done with a plain memcpy: the object doesn't point into itself and nobody
+// points at it. Trivially copyable types qualify automatically, other types opt in:
+//
+//     template <>
+//     struct IsTriviallyRelocatable<MyType> : std::true_type {};
+//
+// Vector uses it to grow with memcpy or realloc instead of moving element by element.
+template <typename T>
+struct IsTriviallyRelocatable : std::is_trivially_copyable<T> {};
+
+template <typename T>
+inline constexpr bool kIsTriviallyRelocatable = IsTriviallyRelocatable<T>::value;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "compressed_pair.h"
+#include "trivially-relocatable.h"
 
 #include <cstddef>  // std::nullptr_t
 #include <utility>
@@ -237,3 +238,6 @@ public:
 private:
     CompressedPair<T*, Deleter> pair_;
 };
+
+template <typename T, typename Deleter>
+struct IsTriviallyRelocatable<UniquePtr<T, Deleter>> : IsTriviallyRelocatable<Deleter> {};
@@ -1,33 +1,84 @@
+#pragma once
+
+#include "trivially-relocatable.h"
+
 #include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <type_traits>
 #include <algorithm>
 #include <memory>
 #include <iostream>
+#include <utility>
 
-template <typename T>
+// Allocator is any standard allocator, e.g. ArenaAllocator from arena.h. Elements are still
+// constructed in place by the vector itself, the allocator only provides the buffer.
+template <typename T, typename Allocator = std::allocator<T>>
 class Vector {
 private:
+    using AllocTraits = std::allocator_traits<Allocator>;
+
     struct RawMemory{
         T* buf = nullptr;
         size_t capacity_ = 0;
+        [[no_unique_address]] Allocator alloc;
+
+        // Trivially relocatable elements with the default allocator live in malloc memory, so
+        // growing is a realloc, which can extend in place and for big buffers is an mremap.
+        static constexpr bool kUseRealloc = kIsTriviallyRelocatable<T> &&
+                                            std::is_same_v<Allocator, std::allocator<T>> &&
+                                            alignof(T) <= alignof(std::max_align_t);
+
+        T* Allocate(size_t n) {
+            if constexpr (kUseRealloc) {
+                return n ? CheckAllocated(std::malloc(Bytes(n))) : nullptr;
+            } else {
+                return n ? AllocTraits::allocate(alloc, n) : nullptr;
+            }
+        }
 
-        static T* Allocate(size_t n) {
-            return reinterpret_cast<T*>(operator new(n * sizeof(T)));
+        void Deallocate(T* buf) {
+            if constexpr (kUseRealloc) {
+                std::free(buf);
+            } else if (buf) {
+                AllocTraits::deallocate(alloc, buf, capacity_);
+            }
         }
 
-        static void Deallocate(T* buf) {
-            operator delete (buf);
+        // Reallocate grows the buffer to n elements, moving the bytes if it has to.
+        void Reallocate(size_t n) requires kUseRealloc {
+            buf = CheckAllocated(std::realloc(static_cast<void*>(buf), Bytes(n)));
+            capacity_ = n;
         }
 
-        RawMemory() = default;
+        // Bytes is the buffer size for n elements, checked for overflow like allocator::allocate.
+        static size_t Bytes(size_t n) {
+            if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+                throw std::bad_array_new_length();
+            }
+            return n * sizeof(T);
+        }
+
+        static T* CheckAllocated(void* ptr) {
+            if (!ptr) {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(ptr);
+        }
 
-        RawMemory(size_t n) {
+        explicit RawMemory(const Allocator& alloc = Allocator()) : alloc(alloc) {
+        }
+
+        RawMemory(size_t n, const Allocator& alloc) : alloc(alloc) {
             buf = Allocate(n);
             capacity_ = n;
         }
 
         RawMemory(const RawMemory&) = delete;
 
-        RawMemory(RawMemory&& other) {
+        RawMemory(RawMemory&& other) : alloc(other.alloc) {
             swap(other);
         }
 
@@ -57,6 +108,7 @@ private:
         void swap(RawMemory& other) {
             std::swap(buf, other.buf);
             std::swap(capacity_, other.capacity_);
+            std::swap(alloc, other.alloc);
         }
     };
 
@@ -66,23 +118,31 @@ private:
 public:
     Vector() = default;
 
-    Vector(Vector&& other) {
-        Swap(other);
+    explicit Vector(const Allocator& alloc): data_(alloc) {
+    }
+
+    Vector(Vector&& other): data_(std::move(other.data_)), size_(std::exchange(other.size_, 0)) {
     }
 
-    explicit Vector(size_t n): data_(n) {
+    explicit Vector(size_t n, const Allocator& alloc = Allocator()): data_(n, alloc) {
         std::uninitialized_value_construct_n(data_.buf, n);
         size_ = n;
     }
 
-    explicit Vector(const Vector& other): data_(other.size_) {
+    explicit Vector(const Vector& other)
+        : data_(other.size_,
+                AllocTraits::select_on_container_copy_construction(other.data_.alloc)) {
         std::uninitialized_copy_n(other.data_.buf, other.size_, data_.buf);
         size_ = other.size_;
     }
 
     Vector& operator=(const Vector& other) {
         if (other.size_ > data_.capacity_) {
-            Vector tmp(other);
+            // Keep our allocator, the copy only takes the elements.
+            Vector tmp(data_.alloc);
+            tmp.reserve(other.size_);
+            std::uninitialized_copy_n(other.data_.buf, other.size_, tmp.data_.buf);
+            tmp.size_ = other.size_;
             swap(tmp);
         } else {
           for (size_t i = 0; i < std::min(size_, other.size_); ++i) {
@@ -100,7 +160,7 @@ public:
     }
 
     Vector& operator=(Vector&& other) {
-        Swap(other);
+        swap(other);
         return *this;
     }
 
@@ -109,8 +169,19 @@ public:
     }
 
     void reserve(size_t n) {
-        if (n > data_.capacity_) {
-            RawMemory new_data(n);
+        if (n <= data_.capacity_) {
+            return;
+        }
+        if constexpr (RawMemory::kUseRealloc) {
+            data_.Reallocate(n);
+        } else if constexpr (kIsTriviallyRelocatable<T>) {
+            RawMemory new_data(n, data_.alloc);
+            if (size_ > 0) {
+                std::memcpy(static_cast<void*>(new_data.buf), data_.buf, size_ * sizeof(T));
+            }
+            data_.swap(new_data);
+        } else {
+            RawMemory new_data(n, data_.alloc);
             std::uninitialized_move_n(data_.buf, size_, new_data.buf);
             std::destroy_n(data_.buf, size_);
             data_.swap(new_data);
@@ -161,6 +232,10 @@ public:
         return data_.capacity_;
     }
 
+    Allocator get_allocator() const {
+        return data_.alloc;
+    }
+
     const T& operator[](size_t idx) const {
         return data_[idx];
     }